@@ -1,8 +1,19 @@
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/pybind11.h>
 
 #include <IMDFile.h>
+#ifdef IMDLIB_SHARED_MEMORY_CACHE
+#include <IMDSharedMemoryCache.h>
+#endif
+
+#define PICKLE_MAGIC 0x44444d49u // "IMDD"
+#define PICKLE_VERSION 1u
 
 namespace py = pybind11;
 
@@ -25,6 +36,192 @@ namespace imd {
             return accessor(std::get<0>(pushIndexAndMarkerIndex), std::get<1>(pushIndexAndMarkerIndex));
         }
 
+        template<class TCSRAccessor, typename TOut>
+        void toDenseInto(const TCSRAccessor &accessor, pybind11::array_t<TOut> out, std::size_t pushStart,
+                         const pybind11::object &pushEnd, const pybind11::object &markerIndices,
+                         std::size_t numThreads) {
+            const auto &data = accessor.getData();
+            const std::size_t end = pushEnd.is_none() ? data.getNumPushes() : pushEnd.cast<std::size_t>();
+            std::vector<std::size_t> indices;
+            if (markerIndices.is_none()) {
+                indices.resize(data.getNumMarkers());
+                std::iota(indices.begin(), indices.end(), 0);
+            } else {
+                indices = markerIndices.cast<std::vector<std::size_t>>();
+            }
+            if (end < pushStart || out.ndim() != 2 || (std::size_t) out.shape(0) != end - pushStart ||
+                (std::size_t) out.shape(1) != indices.size()) {
+                throw std::invalid_argument("Output array shape does not match push range and marker indices");
+            }
+            auto layout = IMDData::DenseLayout::ROW_MAJOR;
+            if (!(out.flags() & pybind11::array::c_style)) {
+                if (!(out.flags() & pybind11::array::f_style)) {
+                    throw std::invalid_argument("Output array must be C- or Fortran-contiguous");
+                }
+                layout = IMDData::DenseLayout::COLUMN_MAJOR;
+            }
+            TOut *const buffer = out.mutable_data();
+            pybind11::gil_scoped_release release;
+            accessor.toDense(buffer, pushStart, end, indices, layout, numThreads);
+        }
+
+        template<class TCSRAccessor, typename TOut>
+        pybind11::array_t<TOut> toDenseArray(const TCSRAccessor &accessor, std::size_t pushStart,
+                                             const pybind11::object &pushEnd, const pybind11::object &markerIndices,
+                                             bool columnMajor, std::size_t numThreads) {
+            const auto &data = accessor.getData();
+            const std::size_t end = pushEnd.is_none() ? data.getNumPushes() : pushEnd.cast<std::size_t>();
+            const std::size_t numMarkers = markerIndices.is_none() ? data.getNumMarkers() : pybind11::len(markerIndices);
+            const std::vector<std::size_t> shape = {end >= pushStart ? end - pushStart : 0, numMarkers};
+            pybind11::array_t<TOut> out;
+            if (columnMajor) {
+                out = pybind11::array_t<TOut, pybind11::array::f_style>(shape);
+            } else {
+                out = pybind11::array_t<TOut, pybind11::array::c_style>(shape);
+            }
+            toDenseInto<TCSRAccessor, TOut>(accessor, out, pushStart, pushEnd, markerIndices, numThreads);
+            return out;
+        }
+
+        // pickle header: magic, version, sizeof(std::size_t), numPushOffsets, numMarkerIndices, numPulseValues,
+        // numIntensityValues
+        using PickleHeader = std::array<std::uint64_t, 7>;
+
+        template<typename T>
+        pybind11::object pickleBlob(const pybind11::object &owner, const IMDArray<T> &vec, bool outOfBand) {
+            const auto numBytes = vec.size() * sizeof(T);
+            if (outOfBand) {
+                // zero-copy view on the vector, keeping the owning IMDData alive
+                pybind11::array_t<std::uint8_t> view(numBytes, (const std::uint8_t *) vec.data(), owner);
+                // the data is const (and possibly mapped read-only), so the view must not be writeable
+                view.attr("setflags")(pybind11::arg("write") = false);
+                return pybind11::module::import("pickle").attr("PickleBuffer")(view);
+            }
+            return pybind11::bytes((const char *) vec.data(), numBytes);
+        }
+
+        template<typename T>
+        void unpickleBlob(const pybind11::buffer &blob, std::uint64_t size, IMDArray<T> &vec) {
+            const pybind11::buffer_info info = blob.request();
+            if ((std::uint64_t) (info.size * info.itemsize) != size * sizeof(T)) {
+                throw std::invalid_argument("Pickled IMDData buffer size does not match header");
+            }
+            vec.resize(size);
+            std::memcpy(vec.mutableData(), info.ptr, size * sizeof(T));
+        }
+
+        template<typename T>
+        void unpickleList(const pybind11::handle &list, IMDArray<T> &vec) {
+            const auto values = list.cast<std::vector<T>>();
+            vec.resize(values.size());
+            std::copy(values.begin(), values.end(), vec.mutableData());
+        }
+
+        // accessors rely on these invariants for bounds safety
+        void checkUnpickledIMDData(const IMDData &data) {
+            const auto &offsets = data.pushOffsets;
+            if (offsets.empty() || offsets[0] != 0 || offsets[offsets.size() - 1] != data.markerIndices.size() ||
+                !std::is_sorted(offsets.begin(), offsets.end())) {
+                throw std::invalid_argument("Malformed pickled IMDData push offsets");
+            }
+            if (data.pulseValues.size() != data.markerIndices.size() ||
+                data.intensityValues.size() != data.markerIndices.size()) {
+                throw std::invalid_argument("Malformed pickled IMDData values");
+            }
+            if (std::any_of(data.markerIndices.begin(), data.markerIndices.end(),
+                            [&data](std::size_t markerIndex) { return markerIndex >= data.getNumMarkers(); })) {
+                throw std::invalid_argument("Malformed pickled IMDData marker indices");
+            }
+        }
+
+        void checkUnpickledCalibration(const std::vector<std::string> &markerNames,
+                                       const std::vector<std::double_t> &markerSlopes,
+                                       const std::vector<std::double_t> &markerIntercepts) {
+            if (markerSlopes.size() != markerNames.size() || markerIntercepts.size() != markerNames.size()) {
+                throw std::invalid_argument("Pickled IMDData marker calibration does not match marker names");
+            }
+        }
+
+        // versioned state: header blob, marker names, slopes and intercepts, and the four CSR blobs (zero-copy
+        // pickle buffers if out-of-band)
+        pybind11::tuple getIMDDataState(const pybind11::object &self, bool outOfBand) {
+            const auto &data = self.cast<const IMDData &>();
+            const PickleHeader header = {
+                    PICKLE_MAGIC, PICKLE_VERSION, sizeof(std::size_t), data.pushOffsets.size(),
+                    data.markerIndices.size(), data.pulseValues.size(), data.intensityValues.size()
+            };
+            return pybind11::make_tuple(
+                    pybind11::bytes((const char *) header.data(), sizeof(PickleHeader)),
+                    data.getMarkerNames(), data.getMarkerSlopes(), data.getMarkerIntercepts(),
+                    pickleBlob(self, data.pushOffsets, outOfBand), pickleBlob(self, data.markerIndices, outOfBand),
+                    pickleBlob(self, data.pulseValues, outOfBand), pickleBlob(self, data.intensityValues, outOfBand));
+        }
+
+        pybind11::tuple reduceIMDData(const pybind11::object &self, int protocol) {
+            return pybind11::make_tuple(pybind11::module::import("imdpy").attr("_unpickle_imd_data"),
+                                        getIMDDataState(self, protocol >= 5));
+        }
+
+        std::shared_ptr<IMDData> unpickleIMDData(const pybind11::buffer &headerBlob,
+                                                 const std::vector<std::string> &markerNames,
+                                                 const std::vector<std::double_t> &markerSlopes,
+                                                 const std::vector<std::double_t> &markerIntercepts,
+                                                 const pybind11::buffer &pushOffsets,
+                                                 const pybind11::buffer &markerIndices,
+                                                 const pybind11::buffer &pulseValues,
+                                                 const pybind11::buffer &intensityValues) {
+            PickleHeader header;
+            const pybind11::buffer_info headerInfo = headerBlob.request();
+            if (headerInfo.size * headerInfo.itemsize != sizeof(PickleHeader)) {
+                throw std::invalid_argument("Malformed pickled IMDData header");
+            }
+            std::memcpy(header.data(), headerInfo.ptr, sizeof(PickleHeader));
+            if (header[0] != PICKLE_MAGIC || header[2] != sizeof(std::size_t)) {
+                throw std::invalid_argument("Incompatible pickled IMDData");
+            }
+            if (header[1] != PICKLE_VERSION) {
+                throw std::invalid_argument("Unsupported pickled IMDData version: " + std::to_string(header[1]));
+            }
+            checkUnpickledCalibration(markerNames, markerSlopes, markerIntercepts);
+            if (header[3] == 0 || header[4] != header[5] || header[4] != header[6]) {
+                throw std::invalid_argument("Malformed pickled IMDData header");
+            }
+            auto data = std::make_shared<IMDData>(markerNames, markerSlopes, markerIntercepts);
+            unpickleBlob(pushOffsets, header[3], data->pushOffsets);
+            unpickleBlob(markerIndices, header[4], data->markerIndices);
+            unpickleBlob(pulseValues, header[5], data->pulseValues);
+            unpickleBlob(intensityValues, header[6], data->intensityValues);
+            checkUnpickledIMDData(*data);
+            return data;
+        }
+
+        // accepts the versioned state as well as the legacy state (tuple of marker names, slopes and intercepts,
+        // and the CSR vectors as lists) written by imdpy versions before the binary pickle format
+        std::shared_ptr<IMDData> setIMDDataState(const pybind11::tuple &state) {
+            if (state.size() == 8) {
+                return unpickleIMDData(state[0].cast<pybind11::buffer>(), state[1].cast<std::vector<std::string>>(),
+                                       state[2].cast<std::vector<std::double_t>>(),
+                                       state[3].cast<std::vector<std::double_t>>(), state[4].cast<pybind11::buffer>(),
+                                       state[5].cast<pybind11::buffer>(), state[6].cast<pybind11::buffer>(),
+                                       state[7].cast<pybind11::buffer>());
+            }
+            if (state.size() != 7) {
+                throw std::invalid_argument("Malformed pickled IMDData state");
+            }
+            auto markerNames = state[0].cast<std::vector<std::string>>();
+            auto markerSlopes = state[1].cast<std::vector<std::double_t>>();
+            auto markerIntercepts = state[2].cast<std::vector<std::double_t>>();
+            checkUnpickledCalibration(markerNames, markerSlopes, markerIntercepts);
+            auto data = std::make_shared<IMDData>(std::move(markerNames), std::move(markerSlopes),
+                                                  std::move(markerIntercepts));
+            unpickleList(state[3], data->pushOffsets);
+            unpickleList(state[4], data->markerIndices);
+            unpickleList(state[5], data->pulseValues);
+            unpickleList(state[6], data->intensityValues);
+            checkUnpickledIMDData(*data);
+            return data;
+        }
+
 //        alternative implementation to expose CSRAccessor via pybind11
 
 //        template<typename TValue, template<typename T> class TCSRAccessor = IMDData::CSRAccessor>
@@ -67,32 +264,22 @@ PYBIND11_MODULE(imdpy, m) {
         .def("read_data", &imd::IMDFile::readData, "Read the full data set into memory")
         .def("read_metadata", &imd::IMDFile::readMetadata, "Read the raw metadata as text");
 
-    py::class_<imd::IMDData>(m, "IMDData")
+    // held by std::shared_ptr, so that accessors can share ownership of the data
+    py::class_<imd::IMDData, std::shared_ptr<imd::IMDData>>(m, "IMDData")
         .def_property_readonly("num_markers", &imd::IMDData::getNumMarkers, "Number of markers")
         .def_property_readonly("num_pushes", &imd::IMDData::getNumPushes, "Number of pushes")
         .def_property_readonly("marker_names", &imd::IMDData::getMarkerNames, "Marker names")
         .def_property_readonly("pulses", &imd::IMDData::getPulses, "Pulse values")
         .def_property_readonly("intensities", &imd::IMDData::getIntensities, "Intensity values")
-        .def_property_readonly("dual_counts", (const imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)() const) &imd::IMDData::getDualCounts, "Dual counts")
-        .def("get_dual_counts", (const imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)(std::double_t) const) &imd::IMDData::getDualCounts, py::arg("pulseThreshold"), "Dual counts with custom pulse threshold")
-        .def("get_dual_counts", (const imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)(std::double_t, const std::vector<double_t> &, const std::vector<double_t> &) const) &imd::IMDData::getDualCounts, py::arg("pulseThreshold"), py::arg("markerSlopes"), py::arg("markerIntensities"), "Dual counts with custom pulse threshold and calibration curve")
+        .def_property_readonly("dual_counts", (imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)() const) &imd::IMDData::getDualCounts, "Dual counts")
+        .def("get_dual_counts", (imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)(std::double_t) const) &imd::IMDData::getDualCounts, py::arg("pulseThreshold"), "Dual counts with custom pulse threshold")
+        .def("get_dual_counts", (imd::IMDData::CSRDualCountAccessor (imd::IMDData::*)(std::double_t, std::vector<double_t>, std::vector<double_t>) const) &imd::IMDData::getDualCounts, py::arg("pulseThreshold"), py::arg("markerSlopes"), py::arg("markerIntensities"), "Dual counts with custom pulse threshold and calibration curve")
+        .def("__reduce_ex__", imd::py::reduceIMDData, py::arg("protocol"), "Binary pickle support (out-of-band buffers with protocol 5)")
         .def(py::pickle(
-                [](const imd::IMDData &imdData) {
-                    return py::make_tuple(
-                            imdData.markerNames, imdData.markerSlopes, imdData.markerIntercepts,
-                            imdData.pushOffsets, imdData.markerIndices, imdData.pulseValues, imdData.intensityValues);
-                },
-                [](py::tuple t) {
-                    const auto markerNames = t[0].cast<std::vector<std::string>>();
-                    const auto markerSlopes = t[1].cast<std::vector<std::double_t>>();
-                    const auto markerIntercepts = t[2].cast<std::vector<std::double_t>>();
-                    imd::IMDData imdData(markerNames, markerSlopes, markerIntercepts);
-                    imdData.pushOffsets = t[3].cast<std::vector<std::size_t>>();
-                    imdData.markerIndices = t[4].cast<std::vector<std::size_t>>();
-                    imdData.pulseValues = t[5].cast<std::vector<std::uint16_t>>();
-                    imdData.intensityValues = t[6].cast<std::vector<std::uint16_t>>();
-                    return imdData;
-                }));
+                [](const py::object &self) { return imd::py::getIMDDataState(self, false); },
+                [](const py::tuple &state) { return imd::py::setIMDDataState(state); }));
+
+    m.def("_unpickle_imd_data", imd::py::unpickleIMDData, "Reconstructs pickled IMDData");
 
     py::class_<imd::IMDData::CSRValueAccessor>(m, "CSRValueAccessor")
         .def("__getitem__", imd::py::getByMarkerName<imd::IMDData::CSRValueAccessor, std::uint16_t>, py::arg("markerName"), "Value access by marker name")
@@ -100,7 +287,11 @@ PYBIND11_MODULE(imdpy, m) {
         .def("get_by_marker_index", &imd::IMDData::CSRValueAccessor::getByMarkerIndex, py::arg("markerIndex"), "Value access by marker index")
         .def("__getitem__", imd::py::getByPushIndexAndMarkerName<imd::IMDData::CSRValueAccessor, std::uint16_t>, py::arg("pushIndexAndMarkerName"), "Value access by push index and marker name")
         .def("__getitem__", imd::py::getByPushIndexAndMarkerIndex<imd::IMDData::CSRValueAccessor, std::uint16_t>, py::arg("pushIndexAndMarkerIndex"), "Value access by push index and marker index")
-        .def("to_dense", &imd::IMDData::CSRValueAccessor::toDense, "Converts the value matrix to a dense row-major representation");
+        .def("to_dense", (std::vector<std::uint16_t> (imd::IMDData::CSRValueAccessor::*)() const) &imd::IMDData::CSRValueAccessor::toDense, "Converts the value matrix to a dense row-major representation")
+        .def("to_dense_into", imd::py::toDenseInto<imd::IMDData::CSRValueAccessor, std::uint16_t>, py::arg("out").noconvert(), py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("num_threads") = 0, "Writes the value matrix (push range, marker subset) into a C- or Fortran-contiguous array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_into", imd::py::toDenseInto<imd::IMDData::CSRValueAccessor, float>, py::arg("out").noconvert(), py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("num_threads") = 0, "Writes the value matrix (push range, marker subset) into a C- or Fortran-contiguous float32 array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_array", imd::py::toDenseArray<imd::IMDData::CSRValueAccessor, std::uint16_t>, py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("column_major") = false, py::arg("num_threads") = 0, "Converts the value matrix (push range, marker subset) to a dense array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_array_float32", imd::py::toDenseArray<imd::IMDData::CSRValueAccessor, float>, py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("column_major") = false, py::arg("num_threads") = 0, "Converts the value matrix (push range, marker subset) to a dense float32 array (num_threads = 0 uses all hardware threads)");
 
     py::class_<imd::IMDData::CSRDualCountAccessor>(m, "CSRDualCountAccessor")
         .def("__getitem__", imd::py::getByMarkerName<imd::IMDData::CSRDualCountAccessor, std::double_t>, py::arg("markerName"), "Dual count access by marker name")
@@ -108,7 +299,24 @@ PYBIND11_MODULE(imdpy, m) {
         .def("get_by_marker_index", &imd::IMDData::CSRDualCountAccessor::getByMarkerIndex, py::arg("markerIndex"), "Dual count access by marker index")
         .def("__getitem__", imd::py::getByPushIndexAndMarkerName<imd::IMDData::CSRDualCountAccessor, std::double_t>, py::arg("pushIndexAndMarkerName"), "Dual count access by push index and marker name")
         .def("__getitem__", imd::py::getByPushIndexAndMarkerIndex<imd::IMDData::CSRDualCountAccessor, std::double_t>, py::arg("pushIndexAndMarkerIndex"), "Dual count access by push index and marker index")
-        .def("to_dense", &imd::IMDData::CSRDualCountAccessor::toDense, "Converts the dual count matrix to a dense row-major representation");
+        .def("to_dense", (std::vector<std::double_t> (imd::IMDData::CSRDualCountAccessor::*)() const) &imd::IMDData::CSRDualCountAccessor::toDense, "Converts the dual count matrix to a dense row-major representation")
+        .def("to_dense_into", imd::py::toDenseInto<imd::IMDData::CSRDualCountAccessor, std::double_t>, py::arg("out").noconvert(), py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("num_threads") = 0, "Writes the dual count matrix (push range, marker subset) into a C- or Fortran-contiguous array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_into", imd::py::toDenseInto<imd::IMDData::CSRDualCountAccessor, float>, py::arg("out").noconvert(), py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("num_threads") = 0, "Writes the dual count matrix (push range, marker subset) into a C- or Fortran-contiguous float32 array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_array", imd::py::toDenseArray<imd::IMDData::CSRDualCountAccessor, std::double_t>, py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("column_major") = false, py::arg("num_threads") = 0, "Converts the dual count matrix (push range, marker subset) to a dense array (num_threads = 0 uses all hardware threads)")
+        .def("to_dense_array_float32", imd::py::toDenseArray<imd::IMDData::CSRDualCountAccessor, float>, py::arg("push_start") = 0, py::arg("push_end") = py::none(), py::arg("marker_indices") = py::none(), py::arg("column_major") = false, py::arg("num_threads") = 0, "Converts the dual count matrix (push range, marker subset) to a dense float32 array (num_threads = 0 uses all hardware threads)");
+
+#ifdef IMDLIB_SHARED_MEMORY_CACHE
+    py::class_<imd::IMDSharedMemoryCache>(m, "IMDSharedMemoryCache")
+        .def(py::init<const std::string &, std::size_t>(), py::arg("name") = DEFAULT_SHARED_MEMORY_CACHE_NAME, py::arg("capacity") = DEFAULT_SHARED_MEMORY_CACHE_CAPACITY)
+        .def("read_data", [](const imd::IMDSharedMemoryCache &cache, const imd::IMDFile &file) { return cache.readData(file); }, py::arg("file"), py::call_guard<py::gil_scoped_release>(), "Read the full data set from the node-local shared memory cache, parsing the file if it is not cached yet")
+        .def("read_data", [](const imd::IMDSharedMemoryCache &cache, const std::string &path) { return cache.readData(imd::IMDFile(path)); }, py::arg("path"), py::call_guard<py::gil_scoped_release>(), "Read the full data set from the node-local shared memory cache, parsing the file if it is not cached yet")
+        .def_property_readonly("num_segments", &imd::IMDSharedMemoryCache::getNumSegments, "Number of cached data sets")
+        .def_property_readonly("size", &imd::IMDSharedMemoryCache::getSize, "Size of the cached data sets in bytes")
+        .def("clear", &imd::IMDSharedMemoryCache::clear, "Evict all cached data sets that are not in use")
+        .def_static("remove", &imd::IMDSharedMemoryCache::remove, py::arg("name") = DEFAULT_SHARED_MEMORY_CACHE_NAME, "Remove the cache");
+
+    py::register_exception<imd::IMDSharedMemoryException>(m, "IMDSharedMemoryException");
+#endif
 
     py::register_exception<imd::IMDFileIOException>(m, "IMDFileIOException");
     py::register_exception<imd::IMDFileMalformedException>(m, "IMDFileMalformedException");
@@ -0,0 +1,65 @@
+import pickle
+import unittest
+
+import imdpy
+
+# marker names, slopes and intercepts, push offsets, marker indices, pulse values and intensity values of 3 pushes
+STATE = (['A', 'B', 'C'], [2., 2., 2.], [1., 1., 1.], [0, 2, 3, 5], [0, 2, 1, 0, 2], [1, 2, 3, 4, 5], [6, 7, 8, 9, 10])
+
+
+def create_data(state=STATE):
+    data = imdpy.IMDData.__new__(imdpy.IMDData)
+    data.__setstate__(state)
+    return data
+
+
+def create_legacy_pickle(state=STATE):
+    # stream written by imdpy versions before the binary pickle format: IMDData.__new__, then __setstate__(state)
+    body = pickle.dumps(state, protocol=2)
+    return b'\x80\x02cimdpy\nIMDData\n)\x81' + body[2:-1] + b'b.'
+
+
+class PickleTest(unittest.TestCase):
+    def assertDataEqual(self, data, expected):
+        self.assertEqual(data.marker_names, expected.marker_names)
+        self.assertEqual(data.num_pushes, expected.num_pushes)
+        self.assertEqual(data.pulses.to_dense(), expected.pulses.to_dense())
+        self.assertEqual(data.intensities.to_dense(), expected.intensities.to_dense())
+        self.assertEqual(data.dual_counts.to_dense(), expected.dual_counts.to_dense())
+
+    def test_state(self):
+        data = create_data()
+        self.assertEqual(data.num_pushes, 3)
+        self.assertEqual(data.intensities.to_dense(), [6, 0, 7, 0, 8, 0, 9, 0, 10])
+        self.assertDataEqual(create_data(data.__getstate__()), data)
+
+    def test_legacy(self):
+        self.assertDataEqual(pickle.loads(create_legacy_pickle()), create_data())
+
+    def test_protocol_4(self):
+        data = create_data()
+        self.assertDataEqual(pickle.loads(pickle.dumps(data, protocol=4)), data)
+
+    def test_protocol_5_in_band(self):
+        data = create_data()
+        self.assertDataEqual(pickle.loads(pickle.dumps(data, protocol=5)), data)
+
+    def test_protocol_5_out_of_band(self):
+        data = create_data()
+        buffers = []
+        payload = pickle.dumps(data, protocol=5, buffer_callback=buffers.append)
+        self.assertEqual(len(buffers), 4)
+        self.assertTrue(all(buffer.raw().readonly for buffer in buffers))
+        self.assertDataEqual(pickle.loads(payload, buffers=buffers), data)
+
+    def test_malformed(self):
+        with self.assertRaises(ValueError):
+            create_data(STATE[:3] + ([0, 2, 3, 6],) + STATE[4:])
+        with self.assertRaises(ValueError):
+            create_data(STATE[:4] + ([0, 2, 1, 0, 3],) + STATE[5:])
+        with self.assertRaises(ValueError):
+            pickle.loads(create_legacy_pickle(STATE[:6] + ([6, 7],)))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,139 @@
+#ifndef IMD_IMDARRAY_H
+#define IMD_IMDARRAY_H
+
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace imd {
+
+    // vector-like array that either owns its values or provides a read-only view on external memory (e.g. a shared
+    // memory segment), which is kept alive by the array and all of its copies
+    template<typename T>
+    class IMDArray {
+    private:
+        std::vector<T> values;
+        std::shared_ptr<const T> externalValues;
+        const T *ptr = nullptr;
+        std::size_t count = 0;
+
+        void update() {
+            ptr = values.data();
+            count = values.size();
+        }
+
+        void checkOwned() const {
+            if (externalValues) {
+                throw std::logic_error("Cannot modify an array that views external memory");
+            }
+        }
+
+    public:
+        IMDArray() = default;
+
+        IMDArray(std::shared_ptr<const T> externalValues, std::size_t size)
+                : externalValues(std::move(externalValues)), ptr(this->externalValues.get()), count(size) {
+        }
+
+        IMDArray(const IMDArray &other) : values(other.values), externalValues(other.externalValues) {
+            ptr = externalValues ? other.ptr : values.data();
+            count = other.count;
+        }
+
+        IMDArray(IMDArray &&other) noexcept
+                : values(std::move(other.values)), externalValues(std::move(other.externalValues)), ptr(other.ptr),
+                  count(other.count) {
+            other.update();
+        }
+
+        IMDArray &operator=(const IMDArray &other) {
+            if (this != &other) {
+                values = other.values;
+                externalValues = other.externalValues;
+                ptr = externalValues ? other.ptr : values.data();
+                count = other.count;
+            }
+            return *this;
+        }
+
+        IMDArray &operator=(IMDArray &&other) noexcept {
+            if (this != &other) {
+                values = std::move(other.values);
+                externalValues = std::move(other.externalValues);
+                ptr = other.ptr;
+                count = other.count;
+                other.update();
+            }
+            return *this;
+        }
+
+        bool isExternal() const {
+            return static_cast<bool>(externalValues);
+        }
+
+        const T *data() const {
+            return ptr;
+        }
+
+        // mutable access is only available for arrays owning their values
+        T *mutableData() {
+            checkOwned();
+            return values.data();
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        const T *begin() const {
+            return ptr;
+        }
+
+        const T *end() const {
+            return ptr + count;
+        }
+
+        const T &operator[](std::size_t index) const {
+            return ptr[index];
+        }
+
+        std::size_t capacity() const {
+            return externalValues ? count : values.capacity();
+        }
+
+        void push_back(const T &value) {
+            checkOwned();
+            values.push_back(value);
+            update();
+        }
+
+        void reserve(std::size_t size) {
+            checkOwned();
+            values.reserve(size);
+            update();
+        }
+
+        void resize(std::size_t size) {
+            checkOwned();
+            values.resize(size);
+            update();
+        }
+
+        void shrink_to_fit() {
+            if (!externalValues) {
+                values.shrink_to_fit();
+                update();
+            }
+        }
+
+    };
+
+}
+
+
+#endif //IMD_IMDARRAY_H
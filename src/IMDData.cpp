@@ -2,14 +2,15 @@
 
 namespace imd {
 
-    IMDData::IMDData(const std::vector<std::string> &markerNames,
-                     const std::vector<std::double_t> &markerSlopes,
-                     const std::vector<std::double_t> &markerIntercepts)
-            : markerNames(markerNames), markerSlopes(markerSlopes), markerIntercepts(markerIntercepts),
-              markerNameIndices(createMarkerNameIndices(markerNames)) {
+    IMDData::IMDData(std::vector<std::string> markerNames,
+                     std::vector<std::double_t> markerSlopes,
+                     std::vector<std::double_t> markerIntercepts)
+            : markerNames(std::move(markerNames)), markerSlopes(std::move(markerSlopes)),
+              markerIntercepts(std::move(markerIntercepts)),
+              markerNameIndices(createMarkerNameIndices(this->markerNames)) {
     }
 
-    const std::map<std::string, std::size_t>
+    std::map<std::string, std::size_t>
     IMDData::createMarkerNameIndices(const std::vector<std::string> &markerNames) {
         std::map<std::string, std::size_t> markerNameIndices;
         for (std::size_t i = 0; i < markerNames.size(); ++i) {
@@ -18,6 +19,20 @@ namespace imd {
         return markerNameIndices;
     }
 
+    void IMDData::reserve(std::size_t numPushes, std::size_t numNonZeros) {
+        pushOffsets.reserve(numPushes + 1);
+        markerIndices.reserve(numNonZeros);
+        pulseValues.reserve(numNonZeros);
+        intensityValues.reserve(numNonZeros);
+    }
+
+    void IMDData::shrinkToFit() {
+        pushOffsets.shrink_to_fit();
+        markerIndices.shrink_to_fit();
+        pulseValues.shrink_to_fit();
+        intensityValues.shrink_to_fit();
+    }
+
     std::size_t IMDData::getNumPushes() const {
         return pushOffsets.size() - 1;
     }
@@ -30,30 +45,43 @@ namespace imd {
         return markerNames;
     }
 
-    const IMDData::CSRValueAccessor IMDData::getPulses() const {
+    const std::vector<std::double_t> &IMDData::getMarkerSlopes() const {
+        return markerSlopes;
+    }
+
+    const std::vector<std::double_t> &IMDData::getMarkerIntercepts() const {
+        return markerIntercepts;
+    }
+
+    IMDData::CSRValueAccessor IMDData::getPulses() const {
         return CSRValueAccessor(*this, pulseValues);
     }
 
-    const IMDData::CSRValueAccessor IMDData::getIntensities() const {
+    IMDData::CSRValueAccessor IMDData::getIntensities() const {
         return CSRValueAccessor(*this, intensityValues);
     }
 
-    const IMDData::CSRDualCountAccessor IMDData::getDualCounts() const {
+    IMDData::CSRDualCountAccessor IMDData::getDualCounts() const {
         return getDualCounts(DEFAULT_PULSE_THRESHOLD);
     }
 
-    const IMDData::CSRDualCountAccessor IMDData::getDualCounts(std::double_t pulseThreshold) const {
-        return getDualCounts(pulseThreshold, markerSlopes, markerIntercepts);
+    IMDData::CSRDualCountAccessor IMDData::getDualCounts(std::double_t pulseThreshold) const {
+        return CSRDualCountAccessor(*this, pulseThreshold);
     }
 
-    const IMDData::CSRDualCountAccessor
-    IMDData::getDualCounts(std::double_t pulseThreshold, const std::vector<std::double_t> &markerSlopes,
-                           const std::vector<std::double_t> &markerIntercepts) const {
-        return CSRDualCountAccessor(*this, pulseThreshold, markerSlopes, markerIntercepts);
+    IMDData::CSRDualCountAccessor
+    IMDData::getDualCounts(std::double_t pulseThreshold, std::vector<std::double_t> markerSlopes,
+                           std::vector<std::double_t> markerIntercepts) const {
+        return CSRDualCountAccessor(*this, pulseThreshold, std::move(markerSlopes), std::move(markerIntercepts));
     }
 
     template<typename T>
-    IMDData::CSRAccessor<T>::CSRAccessor(const IMDData &data) : data(data) {
+    IMDData::CSRAccessor<T>::CSRAccessor(const IMDData &data) : dataOwner(data.weak_from_this().lock()), data(data) {
+    }
+
+    template<typename T>
+    const IMDData &IMDData::CSRAccessor<T>::getData() const {
+        return data;
     }
 
     template<typename T>
@@ -109,17 +137,90 @@ namespace imd {
 
     template<typename T>
     std::vector<T> IMDData::CSRAccessor<T>::toDense() const {
-        std::vector<T> matrix(data.getNumPushes() * data.getNumMarkers(), 0);
-        for (std::size_t pushIndex = 0; pushIndex < data.getNumPushes(); ++pushIndex) {
-            for (std::size_t i = data.pushOffsets[pushIndex]; i < data.pushOffsets[pushIndex + 1]; ++i) {
-                std::size_t markerIndex = data.markerIndices[i];
-                matrix[pushIndex * data.getNumMarkers() + markerIndex] = getValue(i);
+        std::vector<std::size_t> markerIndices(data.getNumMarkers());
+        std::iota(markerIndices.begin(), markerIndices.end(), 0);
+        std::vector<T> matrix(data.getNumPushes() * data.getNumMarkers());
+        fillDense(matrix.data(), 0, data.getNumPushes(), markerIndices, DenseLayout::ROW_MAJOR, 0, false);
+        return matrix;
+    }
+
+    template<typename T>
+    template<typename U>
+    void IMDData::CSRAccessor<T>::toDense(U *buffer, std::size_t pushStart, std::size_t pushEnd,
+                                          const std::vector<std::size_t> &markerIndices,
+                                          DenseLayout layout, std::size_t numThreads) const {
+        fillDense(buffer, pushStart, pushEnd, markerIndices, layout, numThreads, true);
+    }
+
+    template<typename T>
+    template<typename U>
+    void IMDData::CSRAccessor<T>::fillDense(U *buffer, std::size_t pushStart, std::size_t pushEnd,
+                                            const std::vector<std::size_t> &markerIndices, DenseLayout layout,
+                                            std::size_t numThreads, bool zeroRows) const {
+        if (pushStart > pushEnd || pushEnd > data.getNumPushes()) {
+            throw std::out_of_range("Push range out of range: [" + std::to_string(pushStart) + ", " +
+                                    std::to_string(pushEnd) + ")");
+        }
+        // map marker indices to output columns (columns of unselected markers are npos)
+        const auto npos = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> markerColumns(data.getNumMarkers(), npos);
+        for (std::size_t column = 0; column < markerIndices.size(); ++column) {
+            if (markerIndices[column] >= data.getNumMarkers()) {
+                throw std::out_of_range("Marker index out of range: " + std::to_string(markerIndices[column]));
+            }
+            if (markerColumns[markerIndices[column]] != npos) {
+                throw std::invalid_argument("Duplicate marker index: " + std::to_string(markerIndices[column]));
             }
+            markerColumns[markerIndices[column]] = column;
+        }
+        // strides of the output matrix
+        const std::size_t numRows = pushEnd - pushStart;
+        const std::size_t numColumns = markerIndices.size();
+        const std::size_t rowStride = layout == DenseLayout::ROW_MAJOR ? numColumns : 1;
+        const std::size_t columnStride = layout == DenseLayout::ROW_MAJOR ? 1 : numRows;
+        // fill tiles of consecutive pushes; tiles never share output elements
+        const std::size_t numTiles = (numRows + DENSE_TILE_NUM_PUSHES - 1) / DENSE_TILE_NUM_PUSHES;
+        std::atomic<std::size_t> nextTile(0);
+        const auto fillTiles = [&]() {
+            for (std::size_t tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                const std::size_t tileRowStart = tile * DENSE_TILE_NUM_PUSHES;
+                const std::size_t tileRowEnd = std::min(tileRowStart + DENSE_TILE_NUM_PUSHES, numRows);
+                for (std::size_t row = tileRowStart; row < tileRowEnd; ++row) {
+                    U *const rowPtr = buffer + row * rowStride;
+                    if (zeroRows) {
+                        for (std::size_t column = 0; column < numColumns; ++column) {
+                            rowPtr[column * columnStride] = U();
+                        }
+                    }
+                    const std::size_t pushIndex = pushStart + row;
+                    for (std::size_t i = data.pushOffsets[pushIndex]; i < data.pushOffsets[pushIndex + 1]; ++i) {
+                        const std::size_t column = markerColumns[data.markerIndices[i]];
+                        if (column != npos) {
+                            rowPtr[column * columnStride] = static_cast<U>(getValue(i));
+                        }
+                    }
+                }
+            }
+        };
+        if (numThreads == 0) {
+            numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        numThreads = std::min(numThreads, numTiles);
+        std::vector<std::thread> threads;
+        try {
+            for (std::size_t threadIndex = 1; threadIndex < numThreads; ++threadIndex) {
+                threads.emplace_back(fillTiles);
+            }
+        } catch (const std::system_error &) {
+            // thread limit reached; the started threads and the calling thread share the remaining tiles
+        }
+        fillTiles();
+        for (std::thread &thread : threads) {
+            thread.join();
         }
-        return matrix;
     }
 
-    IMDData::CSRValueAccessor::CSRValueAccessor(const IMDData &data, const std::vector<std::uint16_t> &values)
+    IMDData::CSRValueAccessor::CSRValueAccessor(const IMDData &data, const IMDArray<std::uint16_t> &values)
             : CSRAccessor(data), values(values) {
     }
 
@@ -127,11 +228,22 @@ namespace imd {
         return values[index];
     }
 
+    IMDData::CSRDualCountAccessor::CSRDualCountAccessor(const IMDData &data, std::double_t pulseThreshold)
+            : CSRAccessor(data), pulseThreshold(pulseThreshold), markerSlopes(data.markerSlopes.data()),
+              markerIntercepts(data.markerIntercepts.data()) {
+    }
+
     IMDData::CSRDualCountAccessor::CSRDualCountAccessor(const IMDData &data, std::double_t pulseThreshold,
-                                                        const std::vector<std::double_t> &markerSlopes,
-                                                        const std::vector<std::double_t> &markerIntercepts)
-            : CSRAccessor(data), pulseThreshold(pulseThreshold), markerSlopes(markerSlopes),
-              markerIntercepts(markerIntercepts) {
+                                                        std::vector<std::double_t> markerSlopes,
+                                                        std::vector<std::double_t> markerIntercepts)
+            : CSRAccessor(data), pulseThreshold(pulseThreshold),
+              customMarkerSlopes(std::make_shared<const std::vector<std::double_t>>(std::move(markerSlopes))),
+              customMarkerIntercepts(std::make_shared<const std::vector<std::double_t>>(std::move(markerIntercepts))),
+              markerSlopes(customMarkerSlopes->data()), markerIntercepts(customMarkerIntercepts->data()) {
+        if (customMarkerSlopes->size() != data.getNumMarkers() ||
+            customMarkerIntercepts->size() != data.getNumMarkers()) {
+            throw std::invalid_argument("Number of marker slopes/intercepts does not match number of markers");
+        }
     }
 
     std::double_t IMDData::CSRDualCountAccessor::getValue(std::size_t index) const {
@@ -151,4 +263,24 @@ namespace imd {
     template
     class IMDData::CSRAccessor<std::double_t>;
 
+    template
+    void IMDData::CSRAccessor<std::uint16_t>::toDense<std::uint16_t>(
+            std::uint16_t *, std::size_t, std::size_t, const std::vector<std::size_t> &, DenseLayout,
+            std::size_t) const;
+
+    template
+    void IMDData::CSRAccessor<std::uint16_t>::toDense<float>(
+            float *, std::size_t, std::size_t, const std::vector<std::size_t> &, DenseLayout,
+            std::size_t) const;
+
+    template
+    void IMDData::CSRAccessor<std::double_t>::toDense<std::double_t>(
+            std::double_t *, std::size_t, std::size_t, const std::vector<std::size_t> &, DenseLayout,
+            std::size_t) const;
+
+    template
+    void IMDData::CSRAccessor<std::double_t>::toDense<float>(
+            float *, std::size_t, std::size_t, const std::vector<std::size_t> &, DenseLayout,
+            std::size_t) const;
+
 }
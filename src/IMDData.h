@@ -3,29 +3,53 @@
 
 
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <cmath>
+#include <numeric>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
+#include "IMDArray.h"
+
 #define DEFAULT_PULSE_THRESHOLD 3.
+#define DENSE_TILE_NUM_PUSHES 4096
 
 namespace imd {
 
-    struct IMDData {
+    struct IMDData : public std::enable_shared_from_this<IMDData> {
     public:
 
+        enum class DenseLayout {
+            ROW_MAJOR, COLUMN_MAJOR
+        };
+
+        // accessors share ownership of the data if it is owned by a std::shared_ptr (e.g. in Python), and
+        // reference it otherwise
         template<typename T>
         class CSRAccessor {
         protected:
+            const std::shared_ptr<const IMDData> dataOwner;
             const IMDData &data;
 
             virtual T getValue(std::size_t index) const = 0;
 
+            // fills the rows of the dense matrix in parallel tiles; rows are zeroed first unless zeroRows is false
+            // (e.g. for value-initialized buffers)
+            template<typename U>
+            void fillDense(U *buffer, std::size_t pushStart, std::size_t pushEnd,
+                           const std::vector<std::size_t> &markerIndices, DenseLayout layout, std::size_t numThreads,
+                           bool zeroRows) const;
+
         public:
             explicit CSRAccessor(const IMDData &data);
 
+            const IMDData &getData() const;
+
             std::vector<T> operator[](const std::string &markerName) const;
 
             std::vector<T> getByPushIndex(std::size_t pushIndex) const;
@@ -38,51 +62,80 @@ namespace imd {
 
             std::vector<T> toDense() const;
 
+            // writes pushes [pushStart, pushEnd) of the selected markers into a caller-provided buffer of
+            // (pushEnd - pushStart) * markerIndices.size() elements, filled in parallel tiles of pushes
+            // (numThreads = 0 uses all available hardware threads); marker indices must be unique
+            template<typename U>
+            void toDense(U *buffer, std::size_t pushStart, std::size_t pushEnd,
+                         const std::vector<std::size_t> &markerIndices,
+                         DenseLayout layout = DenseLayout::ROW_MAJOR, std::size_t numThreads = 0) const;
+
         };
 
         class CSRValueAccessor : public CSRAccessor<std::uint16_t> {
         private:
-            const std::vector<std::uint16_t> &values;
+            const IMDArray<std::uint16_t> &values;
 
             std::uint16_t getValue(std::size_t index) const override;
 
         public:
-            CSRValueAccessor(const IMDData &data, const std::vector<std::uint16_t> &values);
+            CSRValueAccessor(const IMDData &data, const IMDArray<std::uint16_t> &values);
 
         };
 
         class CSRDualCountAccessor : public CSRAccessor<std::double_t> {
         private:
             const std::double_t pulseThreshold;
-            const std::vector<std::double_t> markerSlopes;
-            const std::vector<std::double_t> markerIntercepts;
+            const std::shared_ptr<const std::vector<std::double_t>> customMarkerSlopes;
+            const std::shared_ptr<const std::vector<std::double_t>> customMarkerIntercepts;
+            const std::double_t *const markerSlopes;
+            const std::double_t *const markerIntercepts;
 
             std::double_t getValue(std::size_t index) const override;
 
         public:
+            // uses the calibration of the data set
+            CSRDualCountAccessor(const IMDData &data, std::double_t pulseThreshold);
+
             CSRDualCountAccessor(const IMDData &data, std::double_t pulseThreshold,
-                                 const std::vector<std::double_t> &markerSlopes,
-                                 const std::vector<std::double_t> &markerIntercepts);
+                                 std::vector<std::double_t> markerSlopes,
+                                 std::vector<std::double_t> markerIntercepts);
 
         };
 
     private:
-        static const std::map<std::string, std::size_t>
+        // not const (so that data sets can be assigned), but private: accessors rely on the marker name indices and
+        // reference the calibration
+        std::vector<std::string> markerNames;
+        std::vector<std::double_t> markerSlopes;
+        std::vector<std::double_t> markerIntercepts;
+        std::map<std::string, std::size_t> markerNameIndices;
+
+        static std::map<std::string, std::size_t>
         createMarkerNameIndices(const std::vector<std::string> &markerNames);
 
     public:
-        const std::vector<std::string> markerNames;
-        const std::vector<std::double_t> markerSlopes;
-        const std::vector<std::double_t> markerIntercepts;
-        const std::map<std::string, std::size_t> markerNameIndices;
+        IMDArray<std::size_t> pushOffsets;
+        IMDArray<std::size_t> markerIndices;
+        IMDArray<std::uint16_t> pulseValues;
+        IMDArray<std::uint16_t> intensityValues;
 
-        std::vector<std::size_t> pushOffsets;
-        std::vector<std::size_t> markerIndices;
-        std::vector<std::uint16_t> pulseValues;
-        std::vector<std::uint16_t> intensityValues;
+        IMDData(std::vector<std::string> markerNames, std::vector<std::double_t> markerSlopes,
+                std::vector<std::double_t> markerIntercepts);
 
-        IMDData(const std::vector<std::string> &markerNames, const std::vector<std::double_t> &markerSlopes,
-                const std::vector<std::double_t> &markerIntercepts);
+        IMDData(const IMDData &other) = default;
+
+        IMDData(IMDData &&other) = default;
+
+        IMDData &operator=(const IMDData &other) = default;
+
+        IMDData &operator=(IMDData &&other) = default;
+
+        // reserves the CSR vectors for the given number of pushes and (estimated) number of non-zero entries
+        void reserve(std::size_t numPushes, std::size_t numNonZeros);
+
+        // releases unused reserved memory of the CSR vectors
+        void shrinkToFit();
 
         std::size_t getNumPushes() const;
 
@@ -90,17 +143,21 @@ namespace imd {
 
         const std::vector<std::string> &getMarkerNames() const;
 
-        const CSRValueAccessor getPulses() const;
+        const std::vector<std::double_t> &getMarkerSlopes() const;
+
+        const std::vector<std::double_t> &getMarkerIntercepts() const;
+
+        CSRValueAccessor getPulses() const;
 
-        const CSRValueAccessor getIntensities() const;
+        CSRValueAccessor getIntensities() const;
 
-        const CSRDualCountAccessor getDualCounts() const;
+        CSRDualCountAccessor getDualCounts() const;
 
-        const CSRDualCountAccessor getDualCounts(std::double_t pulseThreshold) const;
+        CSRDualCountAccessor getDualCounts(std::double_t pulseThreshold) const;
 
-        const CSRDualCountAccessor
-        getDualCounts(std::double_t pulseThreshold, const std::vector<std::double_t> &markerSlopes,
-                      const std::vector<std::double_t> &markerIntercepts) const;
+        CSRDualCountAccessor
+        getDualCounts(std::double_t pulseThreshold, std::vector<std::double_t> markerSlopes,
+                      std::vector<std::double_t> markerIntercepts) const;
 
     };
 
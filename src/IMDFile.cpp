@@ -114,9 +114,40 @@ namespace imd {
         return metadata;
     }
 
+    std::size_t IMDFile::countNonZeros(const std::vector<std::uint16_t> &buffer, std::size_t numValues) {
+        std::size_t numNonZeros = 0;
+        for (std::size_t i = 0; i < numValues; ++i) {
+            numNonZeros += buffer[2 * i] > 0 ? 1 : 0;
+        }
+        return numNonZeros;
+    }
+
+    std::double_t IMDFile::estimateNonZeroDensity(std::ifstream &file, std::size_t numPushes, std::size_t numMarkers,
+                                                  std::vector<std::uint16_t> &buffer) {
+        const std::size_t pushSize = 2 * numMarkers * sizeof(std::uint16_t);
+        const std::size_t numChunks = (numPushes + READ_BUFFER_NUM_PUSHES - 1) / READ_BUFFER_NUM_PUSHES;
+        const std::size_t numSampledChunks = std::min<std::size_t>(numChunks, NON_ZERO_ESTIMATE_NUM_CHUNKS);
+        std::size_t numSampledPushes = 0;
+        std::size_t numSampledNonZeros = 0;
+        for (std::size_t i = 0; i < numSampledChunks; ++i) {
+            // the center chunk of each of numSampledChunks equally sized ranges of chunks
+            const std::size_t chunkStart = (2 * i + 1) * numChunks / (2 * numSampledChunks) * READ_BUFFER_NUM_PUSHES;
+            const std::size_t chunkNumPushes = std::min<std::size_t>(READ_BUFFER_NUM_PUSHES, numPushes - chunkStart);
+            file.seekg(chunkStart * pushSize, std::ios_base::beg);
+            file.read((char *) buffer.data(), chunkNumPushes * pushSize);
+            numSampledPushes += chunkNumPushes;
+            numSampledNonZeros += countNonZeros(buffer, chunkNumPushes * numMarkers);
+        }
+        return numSampledPushes > 0 ? (std::double_t) numSampledNonZeros / numSampledPushes : 0.;
+    }
+
     IMDFile::IMDFile(const std::string &path) : path(path) {
     }
 
+    const std::string &IMDFile::getPath() const {
+        return path;
+    }
+
     std::string IMDFile::readMetadata() const {
         std::ifstream file(path, std::ios_base::binary);
         if (!file) {
@@ -126,7 +157,7 @@ namespace imd {
         return readMetadataInternal(file, &xmlStartPos, &xmlEndPos);
     }
 
-    const IMDData IMDFile::readData() const {
+    IMDData IMDFile::readData() const {
         // open file
         std::ifstream file(path, std::ios_base::binary);
         if (!file) {
@@ -189,25 +220,55 @@ namespace imd {
                 }
             }
         }
-        // read data
-        IMDData data(markerNames, markerSlopes, markerIntercepts);
+        // read data in chunks of pushes, reserving memory based on the non-zero density of chunks sampled across the
+        // file; if the pushes read so far exceed the reservation, the rest of the file is reserved based on the
+        // sampled density again, but at least by doubling the reservation (so that underestimates do not lead to
+        // repeated reallocation)
+        IMDData data(std::move(markerNames), std::move(markerSlopes), std::move(markerIntercepts));
+        const std::size_t numMarkers = data.getNumMarkers();
+        const std::size_t pushSize = 2 * numMarkers * sizeof(std::uint16_t);
+        const std::size_t numPushes = xmlStartPos / pushSize;
+        std::vector<std::uint16_t> buffer(READ_BUFFER_NUM_PUSHES * 2 * numMarkers);
+        const std::double_t density = estimateNonZeroDensity(file, numPushes, numMarkers, buffer);
+        const auto numNonZerosEstimate = (std::size_t) std::ceil(NON_ZERO_RESERVE_FACTOR * density * numPushes);
+        data.reserve(numPushes, std::min(numNonZerosEstimate, numPushes * numMarkers));
+        bool reservationExceeded = false;
         file.seekg(0, std::ios_base::beg);
-        std::vector<std::uint16_t> buffer(2 * markerNames.size());
-        const auto bufferSize = buffer.size() * sizeof(std::uint16_t);
-        for (std::size_t pushIndex = 0; pushIndex < xmlStartPos / bufferSize; ++pushIndex) {
-            file.read((char *) buffer.data(), bufferSize);
-            data.pushOffsets.push_back(data.markerIndices.size());
-            for (std::size_t markerIndex = 0; markerIndex < markerNames.size(); ++markerIndex) {
-                const std::uint16_t intensityValue = buffer[2 * markerIndex];
-                const std::uint16_t pulseValue = buffer[2 * markerIndex + 1];
-                if (intensityValue > 0) {
-                    data.markerIndices.push_back(markerIndex);
-                    data.intensityValues.push_back(intensityValue);
-                    data.pulseValues.push_back(pulseValue);
+        for (std::size_t chunkStart = 0; chunkStart < numPushes; chunkStart += READ_BUFFER_NUM_PUSHES) {
+            const std::size_t chunkNumPushes = std::min<std::size_t>(READ_BUFFER_NUM_PUSHES, numPushes - chunkStart);
+            file.read((char *) buffer.data(), chunkNumPushes * pushSize);
+            const std::size_t numNonZeros = data.markerIndices.size() +
+                                            countNonZeros(buffer, chunkNumPushes * numMarkers);
+            if (numNonZeros > data.markerIndices.capacity()) {
+                const std::size_t numPushesLeft = numPushes - chunkStart - chunkNumPushes;
+                const auto numNonZerosLeftEstimate = (std::size_t) std::ceil(
+                        NON_ZERO_RESERVE_FACTOR * density * numPushesLeft);
+                const std::size_t numNonZerosReserve = std::max(numNonZeros + numNonZerosLeftEstimate,
+                                                                2 * data.markerIndices.capacity());
+                data.reserve(numPushes, std::min(numNonZerosReserve, numNonZeros + numPushesLeft * numMarkers));
+                reservationExceeded = true;
+            }
+            for (std::size_t chunkPushIndex = 0; chunkPushIndex < chunkNumPushes; ++chunkPushIndex) {
+                const std::uint16_t *const pushBuffer = buffer.data() + 2 * numMarkers * chunkPushIndex;
+                data.pushOffsets.push_back(data.markerIndices.size());
+                for (std::size_t markerIndex = 0; markerIndex < numMarkers; ++markerIndex) {
+                    const std::uint16_t intensityValue = pushBuffer[2 * markerIndex];
+                    const std::uint16_t pulseValue = pushBuffer[2 * markerIndex + 1];
+                    if (intensityValue > 0) {
+                        data.markerIndices.push_back(markerIndex);
+                        data.intensityValues.push_back(intensityValue);
+                        data.pulseValues.push_back(pulseValue);
+                    }
                 }
             }
         }
         data.pushOffsets.push_back(data.markerIndices.size());
+        // release the up-front reservation if the sampled chunks were considerably denser than the rest of the file
+        // (slack from growing the reservation is kept, as copying would raise the peak memory usage)
+        if (!reservationExceeded &&
+            data.markerIndices.capacity() > NON_ZERO_SHRINK_FACTOR * data.markerIndices.size()) {
+            data.shrinkToFit();
+        }
         return data;
     }
 
@@ -2,6 +2,7 @@
 #define IMD_IMDFILE_H
 
 
+#include <array>
 #include <fstream>
 #include <pugixml.hpp>
 #include <regex>
@@ -13,6 +14,10 @@
 #include "IMDFileMalformedException.h"
 
 #define SEARCH_BUFFER_SIZE 8192
+#define READ_BUFFER_NUM_PUSHES 1024
+#define NON_ZERO_RESERVE_FACTOR 1.1
+#define NON_ZERO_ESTIMATE_NUM_CHUNKS 16
+#define NON_ZERO_SHRINK_FACTOR 1.5
 #define EXPERIMENT_SCHEMA_START "<ExperimentSchema"
 #define EXPERIMENT_SCHEMA_END "</ExperimentSchema>"
 
@@ -47,12 +52,20 @@ namespace imd {
         static std::string
         readMetadataInternal(std::ifstream &file, std::streamoff *xmlStartPos, std::streamoff *xmlEndPos);
 
+        static std::size_t countNonZeros(const std::vector<std::uint16_t> &buffer, std::size_t numValues);
+
+        // estimates the number of non-zero entries per push from chunks of pushes sampled evenly across the file
+        static std::double_t estimateNonZeroDensity(std::ifstream &file, std::size_t numPushes, std::size_t numMarkers,
+                                                    std::vector<std::uint16_t> &buffer);
+
     public:
         explicit IMDFile(const std::string &path);
 
+        const std::string &getPath() const;
+
         std::string readMetadata() const;
 
-        const IMDData readData() const;
+        IMDData readData() const;
     };
 
 }
@@ -0,0 +1,681 @@
+#include "IMDSharedMemoryCache.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHARED_MEMORY_MAGIC 0x434d4449u // "IDMC"
+#define SHARED_MEMORY_VERSION 2u
+#define SHARED_MEMORY_REGISTRY_TIMEOUT_SECONDS 10
+
+namespace imd {
+
+    enum EntryState : std::uint32_t {
+        ENTRY_EMPTY = 0, ENTRY_LOADING, ENTRY_READY
+    };
+
+    // process holding views on a segment
+    struct RegistryHolder {
+        std::int32_t pid;
+        std::uint32_t count;
+    };
+
+    struct RegistryEntry {
+        std::uint32_t state;
+        std::int32_t loaderPid;
+        std::uint64_t keyHash;
+        std::uint64_t generation;
+        std::uint64_t size;
+        std::uint64_t lastUsed;
+        // views of processes beyond the holder table, which are not released if the processes die
+        std::uint64_t numUntrackedHolders;
+        RegistryHolder holders[SHARED_MEMORY_CACHE_MAX_HOLDERS];
+    };
+
+    struct IMDSharedMemoryCache::Registry {
+        std::atomic<std::uint32_t> initialized;
+        std::uint32_t version;
+        std::uint32_t maxHolders;
+        std::uint32_t removed;
+        // distinguishes the segments of this registry from those of previous registries of the same name
+        std::uint64_t nonce;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        std::uint64_t clock;
+        std::uint64_t size;
+        std::uint64_t nextGeneration;
+        RegistryEntry entries[SHARED_MEMORY_CACHE_MAX_ENTRIES];
+    };
+
+    struct SegmentHeader {
+        std::uint64_t magic;
+        std::uint64_t version;
+        std::uint64_t sizeOfSizeT;
+        std::uint64_t keySize;
+        std::uint64_t keyOffset;
+        std::uint64_t numMarkers;
+        std::uint64_t markerNamesSize;
+        std::uint64_t markerNamesOffset;
+        std::uint64_t markerSlopesOffset;
+        std::uint64_t markerInterceptsOffset;
+        std::uint64_t numPushOffsets;
+        std::uint64_t pushOffsetsOffset;
+        std::uint64_t numValues;
+        std::uint64_t markerIndicesOffset;
+        std::uint64_t pulseValuesOffset;
+        std::uint64_t intensityValuesOffset;
+        std::uint64_t size;
+    };
+
+    // maps a segment and holds one reference of the creating process to its registry entry, which is released on
+    // destruction
+    struct IMDSharedMemoryCache::Segment {
+        const std::shared_ptr<Registry> registry;
+        const std::string name;
+        const std::size_t entryIndex;
+        const std::uint64_t generation;
+        const std::int32_t holderPid;
+        bool tracked = true;
+        void *addr = nullptr;
+        std::size_t size = 0;
+
+        Segment(std::shared_ptr<Registry> registry, std::string name, std::size_t entryIndex,
+                std::uint64_t generation);
+
+        ~Segment();
+    };
+
+    class RegistryLock {
+    private:
+        IMDSharedMemoryCache::Registry &registry;
+
+        static void check(int result, IMDSharedMemoryCache::Registry &registry) {
+            if (result == EOWNERDEAD) {
+                // the previous owner died while holding the lock; the registry itself is updated consistently
+                pthread_mutex_consistent(&registry.mutex);
+            } else if (result != 0 && result != ETIMEDOUT) {
+                throw IMDSharedMemoryException("Failed to lock shared memory registry: " + std::string(strerror(result)));
+            }
+        }
+
+    public:
+        explicit RegistryLock(IMDSharedMemoryCache::Registry &registry) : registry(registry) {
+            check(pthread_mutex_lock(&registry.mutex), registry);
+        }
+
+        ~RegistryLock() {
+            pthread_mutex_unlock(&registry.mutex);
+        }
+
+        RegistryLock(const RegistryLock &other) = delete;
+
+        RegistryLock &operator=(const RegistryLock &other) = delete;
+
+        void wait() {
+            timespec timeout{};
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_sec += 1;
+            check(pthread_cond_timedwait(&registry.cond, &registry.mutex, &timeout), registry);
+        }
+
+    };
+
+    static std::uint64_t hashKey(const std::string &key) {
+        // FNV-1a, stable across processes
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const char &c : key) {
+            hash ^= (std::uint8_t) c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string getSegmentName(const IMDSharedMemoryCache::Registry &registry, const std::string &name,
+                                      std::uint64_t generation) {
+        char nonce[17];
+        std::snprintf(nonce, sizeof(nonce), "%016llx", (unsigned long long) registry.nonce);
+        return "/" + name + "." + nonce + "." + std::to_string(generation);
+    }
+
+    static bool isAlive(std::int32_t pid) {
+        return kill(pid, 0) == 0 || errno != ESRCH;
+    }
+
+    // returns the number of references held by live (or untracked) processes, releasing those of dead processes
+    static std::uint64_t countHolders(RegistryEntry &entry) {
+        std::uint64_t count = entry.numUntrackedHolders;
+        for (RegistryHolder &holder : entry.holders) {
+            if (holder.count > 0 && !isAlive(holder.pid)) {
+                holder = RegistryHolder();
+            }
+            count += holder.count;
+        }
+        return count;
+    }
+
+    // returns whether the reference is tracked by the holder table; if it is full, the reference is counted untracked
+    static bool acquireHolder(RegistryEntry &entry, std::int32_t pid) {
+        RegistryHolder *freeHolder = nullptr;
+        for (RegistryHolder &holder : entry.holders) {
+            if (holder.count > 0 && holder.pid == pid) {
+                holder.count += 1;
+                return true;
+            }
+            if (freeHolder == nullptr && (holder.count == 0 || !isAlive(holder.pid))) {
+                freeHolder = &holder;
+            }
+        }
+        if (freeHolder == nullptr) {
+            entry.numUntrackedHolders += 1;
+            return false;
+        }
+        freeHolder->pid = pid;
+        freeHolder->count = 1;
+        return true;
+    }
+
+    static void releaseHolder(RegistryEntry &entry, std::int32_t pid, bool tracked) {
+        if (!tracked) {
+            entry.numUntrackedHolders -= entry.numUntrackedHolders > 0 ? 1 : 0;
+            return;
+        }
+        for (RegistryHolder &holder : entry.holders) {
+            if (holder.count > 0 && holder.pid == pid) {
+                holder.count -= 1;
+                return;
+            }
+        }
+    }
+
+    static std::size_t align(std::size_t offset) {
+        return (offset + SHARED_MEMORY_SEGMENT_ALIGNMENT - 1) / SHARED_MEMORY_SEGMENT_ALIGNMENT *
+               SHARED_MEMORY_SEGMENT_ALIGNMENT;
+    }
+
+    static void evictEntry(IMDSharedMemoryCache::Registry &registry, const std::string &name, std::size_t entryIndex) {
+        RegistryEntry &entry = registry.entries[entryIndex];
+        shm_unlink(getSegmentName(registry, name, entry.generation).c_str());
+        registry.size -= entry.size;
+        entry = RegistryEntry();
+    }
+
+    static bool evictLeastRecentlyUsed(IMDSharedMemoryCache::Registry &registry, const std::string &name) {
+        std::size_t lruEntryIndex = SHARED_MEMORY_CACHE_MAX_ENTRIES;
+        for (std::size_t i = 0; i < SHARED_MEMORY_CACHE_MAX_ENTRIES; ++i) {
+            RegistryEntry &entry = registry.entries[i];
+            if (entry.state == ENTRY_READY && countHolders(entry) == 0 &&
+                (lruEntryIndex == SHARED_MEMORY_CACHE_MAX_ENTRIES ||
+                 entry.lastUsed < registry.entries[lruEntryIndex].lastUsed)) {
+                lruEntryIndex = i;
+            }
+        }
+        if (lruEntryIndex == SHARED_MEMORY_CACHE_MAX_ENTRIES) {
+            return false;
+        }
+        evictEntry(registry, name, lruEntryIndex);
+        return true;
+    }
+
+    IMDSharedMemoryCache::Segment::Segment(std::shared_ptr<Registry> registry, std::string name,
+                                           std::size_t entryIndex, std::uint64_t generation)
+            : registry(std::move(registry)), name(std::move(name)), entryIndex(entryIndex), generation(generation),
+              holderPid(getpid()) {
+    }
+
+    IMDSharedMemoryCache::Segment::~Segment() {
+        if (addr != nullptr) {
+            munmap(addr, size);
+        }
+        if (getpid() != holderPid) {
+            // inherited by a forked process, which holds no reference
+            return;
+        }
+        try {
+            RegistryLock lock(*registry);
+            RegistryEntry &entry = registry->entries[entryIndex];
+            if (entry.state == ENTRY_READY && entry.generation == generation) {
+                releaseHolder(entry, holderPid, tracked);
+                if (registry->removed && countHolders(entry) == entry.numUntrackedHolders) {
+                    evictEntry(*registry, name, entryIndex);
+                }
+            }
+        } catch (const IMDSharedMemoryException &) {
+            // the reference cannot be released without the registry lock
+        }
+    }
+
+    IMDSharedMemoryCache::IMDSharedMemoryCache(const std::string &name, std::size_t capacity)
+            : name(name), capacity(capacity), registry(openRegistry(name)) {
+    }
+
+    std::shared_ptr<IMDSharedMemoryCache::Registry> IMDSharedMemoryCache::openRegistry(const std::string &name) {
+        const std::string registryName = "/" + name;
+        int fd = shm_open(registryName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        const bool created = fd >= 0;
+        if (!created) {
+            if (errno != EEXIST || (fd = shm_open(registryName.c_str(), O_RDWR, 0600)) < 0) {
+                throw IMDSharedMemoryException("Could not open shared memory registry " + registryName + ": " +
+                                               std::string(strerror(errno)));
+            }
+        }
+        // wait for the creating process to size the registry
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::seconds(SHARED_MEMORY_REGISTRY_TIMEOUT_SECONDS);
+        if (created) {
+            // allocate the pages up front, as writing to unallocated tmpfs pages raises SIGBUS when it is full
+            const int allocateResult = posix_fallocate(fd, 0, sizeof(Registry));
+            if (allocateResult != 0) {
+                close(fd);
+                shm_unlink(registryName.c_str());
+                throw IMDSharedMemoryException("Could not allocate shared memory registry " + registryName + ": " +
+                                               std::string(strerror(allocateResult)));
+            }
+        } else {
+            struct stat registryStat{};
+            while (fstat(fd, &registryStat) == 0 && registryStat.st_size == 0) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    close(fd);
+                    throw IMDSharedMemoryException("Timed out waiting for shared memory registry " + registryName);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if ((std::size_t) registryStat.st_size != sizeof(Registry)) {
+                // e.g. created by a build with a different SHARED_MEMORY_CACHE_MAX_HOLDERS
+                close(fd);
+                throw IMDSharedMemoryException("Incompatible shared memory registry " + registryName);
+            }
+        }
+        void *addr = mmap(nullptr, sizeof(Registry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw IMDSharedMemoryException("Could not map shared memory registry " + registryName);
+        }
+        auto *registry = static_cast<Registry *>(addr);
+        if (created) {
+            // the registry is zero-initialized by posix_fallocate
+            registry->version = SHARED_MEMORY_VERSION;
+            registry->maxHolders = SHARED_MEMORY_CACHE_MAX_HOLDERS;
+            std::random_device randomDevice;
+            registry->nonce = ((std::uint64_t) randomDevice() << 32 | randomDevice()) ^ (std::uint64_t) getpid() ^
+                              (std::uint64_t) std::chrono::system_clock::now().time_since_epoch().count();
+            pthread_mutexattr_t mutexAttr;
+            pthread_mutexattr_init(&mutexAttr);
+            pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(&registry->mutex, &mutexAttr);
+            pthread_mutexattr_destroy(&mutexAttr);
+            pthread_condattr_t condAttr;
+            pthread_condattr_init(&condAttr);
+            pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+            pthread_cond_init(&registry->cond, &condAttr);
+            pthread_condattr_destroy(&condAttr);
+            registry->initialized.store(1, std::memory_order_release);
+        } else {
+            while (registry->initialized.load(std::memory_order_acquire) == 0) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    munmap(addr, sizeof(Registry));
+                    throw IMDSharedMemoryException("Timed out waiting for shared memory registry " + registryName);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (registry->version != SHARED_MEMORY_VERSION || registry->maxHolders != SHARED_MEMORY_CACHE_MAX_HOLDERS) {
+                munmap(addr, sizeof(Registry));
+                throw IMDSharedMemoryException("Incompatible shared memory registry " + registryName);
+            }
+        }
+        return std::shared_ptr<Registry>(registry, [](Registry *registry) {
+            munmap(registry, sizeof(Registry));
+        });
+    }
+
+    std::string IMDSharedMemoryCache::createFileKey(const std::string &path) {
+        char realPath[PATH_MAX];
+        struct stat fileStat{};
+        if (realpath(path.c_str(), realPath) == nullptr || stat(realPath, &fileStat) != 0) {
+            throw IMDFileIOException("Could not open file " + path);
+        }
+        return std::string(realPath) + ":" + std::to_string(fileStat.st_size) + ":" +
+               std::to_string(fileStat.st_mtim.tv_sec) + "." + std::to_string(fileStat.st_mtim.tv_nsec);
+    }
+
+    static IMDData createView(const std::shared_ptr<IMDSharedMemoryCache::Segment> &segment) {
+        const auto *base = static_cast<const char *>(segment->addr);
+        const auto &header = *reinterpret_cast<const SegmentHeader *>(base);
+        // marker names are stored null-terminated
+        std::vector<std::string> markerNames;
+        markerNames.reserve(header.numMarkers);
+        for (const char *name = base + header.markerNamesOffset;
+             name < base + header.markerNamesOffset + header.markerNamesSize; name += markerNames.back().size() + 1) {
+            markerNames.emplace_back(name);
+        }
+        const auto *markerSlopes = reinterpret_cast<const std::double_t *>(base + header.markerSlopesOffset);
+        const auto *markerIntercepts = reinterpret_cast<const std::double_t *>(base + header.markerInterceptsOffset);
+        IMDData data(std::move(markerNames),
+                     std::vector<std::double_t>(markerSlopes, markerSlopes + header.numMarkers),
+                     std::vector<std::double_t>(markerIntercepts, markerIntercepts + header.numMarkers));
+        // the CSR arrays view the segment, keeping it mapped
+        data.pushOffsets = IMDArray<std::size_t>(std::shared_ptr<const std::size_t>(
+                segment, reinterpret_cast<const std::size_t *>(base + header.pushOffsetsOffset)),
+                                                 header.numPushOffsets);
+        data.markerIndices = IMDArray<std::size_t>(std::shared_ptr<const std::size_t>(
+                segment, reinterpret_cast<const std::size_t *>(base + header.markerIndicesOffset)),
+                                                   header.numValues);
+        data.pulseValues = IMDArray<std::uint16_t>(std::shared_ptr<const std::uint16_t>(
+                segment, reinterpret_cast<const std::uint16_t *>(base + header.pulseValuesOffset)),
+                                                   header.numValues);
+        data.intensityValues = IMDArray<std::uint16_t>(std::shared_ptr<const std::uint16_t>(
+                segment, reinterpret_cast<const std::uint16_t *>(base + header.intensityValuesOffset)),
+                                                       header.numValues);
+        return data;
+    }
+
+    static bool isValid(const SegmentHeader &header, std::size_t size) {
+        const auto fits = [&header](std::uint64_t offset, std::uint64_t count, std::uint64_t elementSize) {
+            return offset <= header.size && count <= (header.size - offset) / elementSize;
+        };
+        return header.magic == SHARED_MEMORY_MAGIC && header.version == SHARED_MEMORY_VERSION &&
+               header.sizeOfSizeT == sizeof(std::size_t) && header.size == size &&
+               fits(header.keyOffset, header.keySize, 1) &&
+               fits(header.markerNamesOffset, header.markerNamesSize, 1) &&
+               fits(header.markerSlopesOffset, header.numMarkers, sizeof(std::double_t)) &&
+               fits(header.markerInterceptsOffset, header.numMarkers, sizeof(std::double_t)) &&
+               fits(header.pushOffsetsOffset, header.numPushOffsets, sizeof(std::size_t)) &&
+               fits(header.markerIndicesOffset, header.numValues, sizeof(std::size_t)) &&
+               fits(header.pulseValuesOffset, header.numValues, sizeof(std::uint16_t)) &&
+               fits(header.intensityValuesOffset, header.numValues, sizeof(std::uint16_t));
+    }
+
+    IMDData IMDSharedMemoryCache::attachSegment(std::size_t entryIndex, std::uint64_t generation, bool tracked,
+                                                const std::string &key) const {
+        const auto segment = std::make_shared<Segment>(registry, name, entryIndex, generation);
+        segment->tracked = tracked;
+        const std::string segmentName = getSegmentName(*registry, name, generation);
+        const int fd = shm_open(segmentName.c_str(), O_RDONLY, 0600);
+        if (fd < 0) {
+            throw IMDSharedMemoryException("Could not open shared memory segment " + segmentName);
+        }
+        struct stat segmentStat{};
+        if (fstat(fd, &segmentStat) != 0 || (std::size_t) segmentStat.st_size < sizeof(SegmentHeader)) {
+            close(fd);
+            throw IMDSharedMemoryException("Malformed shared memory segment " + segmentName);
+        }
+        void *addr = mmap(nullptr, (std::size_t) segmentStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw IMDSharedMemoryException("Could not map shared memory segment " + segmentName);
+        }
+        segment->addr = addr;
+        segment->size = (std::size_t) segmentStat.st_size;
+        const auto &header = *static_cast<const SegmentHeader *>(addr);
+        if (!isValid(header, segment->size)) {
+            throw IMDSharedMemoryException("Malformed shared memory segment " + segmentName);
+        }
+        if (header.keySize != key.size() ||
+            std::memcmp(static_cast<const char *>(addr) + header.keyOffset, key.data(), key.size()) != 0) {
+            throw std::out_of_range("Key hash collision");
+        }
+        return createView(segment);
+    }
+
+    IMDData IMDSharedMemoryCache::createSegment(std::size_t entryIndex, std::uint64_t generation,
+                                                const std::string &key, const IMDData &data) const {
+        // compute the segment layout
+        SegmentHeader header{};
+        header.magic = SHARED_MEMORY_MAGIC;
+        header.version = SHARED_MEMORY_VERSION;
+        header.sizeOfSizeT = sizeof(std::size_t);
+        header.keySize = key.size();
+        header.keyOffset = sizeof(SegmentHeader);
+        header.numMarkers = data.getNumMarkers();
+        for (const std::string &markerName : data.getMarkerNames()) {
+            header.markerNamesSize += markerName.size() + 1;
+        }
+        header.markerNamesOffset = align(header.keyOffset + header.keySize);
+        header.markerSlopesOffset = align(header.markerNamesOffset + header.markerNamesSize);
+        header.markerInterceptsOffset = align(header.markerSlopesOffset + header.numMarkers * sizeof(std::double_t));
+        header.numPushOffsets = data.pushOffsets.size();
+        header.pushOffsetsOffset = align(header.markerInterceptsOffset + header.numMarkers * sizeof(std::double_t));
+        header.numValues = data.markerIndices.size();
+        header.markerIndicesOffset = align(header.pushOffsetsOffset + header.numPushOffsets * sizeof(std::size_t));
+        header.pulseValuesOffset = align(header.markerIndicesOffset + header.numValues * sizeof(std::size_t));
+        header.intensityValuesOffset = align(header.pulseValuesOffset + header.numValues * sizeof(std::uint16_t));
+        header.size = align(header.intensityValuesOffset + header.numValues * sizeof(std::uint16_t));
+        // create and map the segment
+        const auto segment = std::make_shared<Segment>(registry, name, entryIndex, generation);
+        const std::string segmentName = getSegmentName(*registry, name, generation);
+        const int fd = shm_open(segmentName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            throw IMDSharedMemoryException("Could not create shared memory segment " + segmentName + ": " +
+                                           std::string(strerror(errno)));
+        }
+        // allocate the pages up front, as writing to unallocated tmpfs pages raises SIGBUS when it is full
+        const int allocateResult = posix_fallocate(fd, 0, (off_t) header.size);
+        if (allocateResult != 0) {
+            close(fd);
+            shm_unlink(segmentName.c_str());
+            throw IMDSharedMemoryException("Could not allocate shared memory segment " + segmentName + ": " +
+                                           std::string(strerror(allocateResult)));
+        }
+        void *addr = mmap(nullptr, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            shm_unlink(segmentName.c_str());
+            throw IMDSharedMemoryException("Could not map shared memory segment " + segmentName);
+        }
+        segment->addr = addr;
+        segment->size = header.size;
+        // write the segment
+        auto *base = static_cast<char *>(addr);
+        std::memcpy(base, &header, sizeof(SegmentHeader));
+        std::memcpy(base + header.keyOffset, key.data(), key.size());
+        char *markerNamePtr = base + header.markerNamesOffset;
+        for (const std::string &markerName : data.getMarkerNames()) {
+            std::memcpy(markerNamePtr, markerName.c_str(), markerName.size() + 1);
+            markerNamePtr += markerName.size() + 1;
+        }
+        std::memcpy(base + header.markerSlopesOffset, data.getMarkerSlopes().data(),
+                    header.numMarkers * sizeof(std::double_t));
+        std::memcpy(base + header.markerInterceptsOffset, data.getMarkerIntercepts().data(),
+                    header.numMarkers * sizeof(std::double_t));
+        std::memcpy(base + header.pushOffsetsOffset, data.pushOffsets.data(),
+                    header.numPushOffsets * sizeof(std::size_t));
+        std::memcpy(base + header.markerIndicesOffset, data.markerIndices.data(),
+                    header.numValues * sizeof(std::size_t));
+        std::memcpy(base + header.pulseValuesOffset, data.pulseValues.data(),
+                    header.numValues * sizeof(std::uint16_t));
+        std::memcpy(base + header.intensityValuesOffset, data.intensityValues.data(),
+                    header.numValues * sizeof(std::uint16_t));
+        mprotect(addr, header.size, PROT_READ);
+        // publish the segment, holding the first reference
+        {
+            RegistryLock lock(*registry);
+            RegistryEntry &entry = registry->entries[entryIndex];
+            if (entry.state != ENTRY_LOADING || entry.generation != generation) {
+                // the entry was reset while loading (e.g. the loader was considered dead)
+                shm_unlink(segmentName.c_str());
+                throw IMDSharedMemoryException("Shared memory cache entry of segment " + segmentName + " was reset");
+            }
+            evict(header.size);
+            entry.state = ENTRY_READY;
+            segment->tracked = acquireHolder(entry, segment->holderPid);
+            entry.size = header.size;
+            entry.lastUsed = ++registry->clock;
+            registry->size += header.size;
+            pthread_cond_broadcast(&registry->cond);
+        }
+        return createView(segment);
+    }
+
+    void IMDSharedMemoryCache::evict(std::size_t requiredSize) const {
+        while (registry->size + requiredSize > capacity && evictLeastRecentlyUsed(*registry, name)) {
+        }
+    }
+
+    IMDData IMDSharedMemoryCache::readData(const IMDFile &file) const {
+        return getData(createFileKey(file.getPath()), [&file]() {
+            return file.readData();
+        });
+    }
+
+    // removes a segment that could not be attached (e.g. removed from /dev/shm or malformed) from the registry
+    static void resetStaleEntry(IMDSharedMemoryCache::Registry &registry, const std::string &name,
+                                std::size_t entryIndex, std::uint64_t generation) {
+        RegistryLock lock(registry);
+        const RegistryEntry &entry = registry.entries[entryIndex];
+        if (entry.state == ENTRY_READY && entry.generation == generation) {
+            evictEntry(registry, name, entryIndex);
+        }
+        pthread_cond_broadcast(&registry.cond);
+    }
+
+    // releases an entry whose segment could not be created
+    static void resetLoadingEntry(IMDSharedMemoryCache::Registry &registry, std::size_t entryIndex,
+                                  std::uint64_t generation) {
+        RegistryLock lock(registry);
+        RegistryEntry &entry = registry.entries[entryIndex];
+        if (entry.state == ENTRY_LOADING && entry.generation == generation) {
+            entry = RegistryEntry();
+        }
+        pthread_cond_broadcast(&registry.cond);
+    }
+
+    IMDData IMDSharedMemoryCache::getData(const std::string &key, const std::function<IMDData()> &loader) const {
+        const std::uint64_t keyHash = hashKey(key);
+        // a stale entry is reset and loaded once more
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            std::size_t entryIndex = SHARED_MEMORY_CACHE_MAX_ENTRIES;
+            std::uint64_t generation = 0;
+            bool attach = false;
+            bool tracked = true;
+            {
+                RegistryLock lock(*registry);
+                while (entryIndex == SHARED_MEMORY_CACHE_MAX_ENTRIES) {
+                    if (registry->removed) {
+                        break;
+                    }
+                    std::size_t emptyEntryIndex = SHARED_MEMORY_CACHE_MAX_ENTRIES;
+                    std::size_t foundEntryIndex = SHARED_MEMORY_CACHE_MAX_ENTRIES;
+                    for (std::size_t i = 0; i < SHARED_MEMORY_CACHE_MAX_ENTRIES; ++i) {
+                        const RegistryEntry &entry = registry->entries[i];
+                        if (entry.state == ENTRY_EMPTY) {
+                            emptyEntryIndex = std::min(emptyEntryIndex, i);
+                        } else if (entry.keyHash == keyHash) {
+                            foundEntryIndex = i;
+                            break;
+                        }
+                    }
+                    if (foundEntryIndex != SHARED_MEMORY_CACHE_MAX_ENTRIES) {
+                        RegistryEntry &entry = registry->entries[foundEntryIndex];
+                        if (entry.state == ENTRY_READY) {
+                            tracked = acquireHolder(entry, getpid());
+                            entry.lastUsed = ++registry->clock;
+                            entryIndex = foundEntryIndex;
+                            generation = entry.generation;
+                            attach = true;
+                        } else if (!isAlive(entry.loaderPid)) {
+                            // the loading process died, possibly after creating the segment
+                            shm_unlink(getSegmentName(*registry, name, entry.generation).c_str());
+                            entry = RegistryEntry();
+                        } else {
+                            lock.wait();
+                        }
+                    } else if (emptyEntryIndex != SHARED_MEMORY_CACHE_MAX_ENTRIES ||
+                               evictLeastRecentlyUsed(*registry, name)) {
+                        for (entryIndex = 0; registry->entries[entryIndex].state != ENTRY_EMPTY; ++entryIndex) {
+                        }
+                        RegistryEntry &entry = registry->entries[entryIndex];
+                        entry.state = ENTRY_LOADING;
+                        entry.loaderPid = getpid();
+                        entry.keyHash = keyHash;
+                        entry.generation = generation = ++registry->nextGeneration;
+                    } else {
+                        // all entries are in use
+                        break;
+                    }
+                }
+            }
+            if (entryIndex == SHARED_MEMORY_CACHE_MAX_ENTRIES) {
+                return loader();
+            }
+            if (attach) {
+                try {
+                    return attachSegment(entryIndex, generation, tracked, key);
+                } catch (const std::out_of_range &) {
+                    // hash collision with another key
+                    return loader();
+                } catch (const IMDSharedMemoryException &) {
+                    resetStaleEntry(*registry, name, entryIndex, generation);
+                    continue;
+                }
+            }
+            std::unique_ptr<IMDData> data;
+            try {
+                data = std::make_unique<IMDData>(loader());
+            } catch (...) {
+                resetLoadingEntry(*registry, entryIndex, generation);
+                throw;
+            }
+            try {
+                return createSegment(entryIndex, generation, key, *data);
+            } catch (const IMDSharedMemoryException &) {
+                // e.g. /dev/shm is full or the entry was reset while loading; serve the data uncached
+                resetLoadingEntry(*registry, entryIndex, generation);
+                return std::move(*data);
+            }
+        }
+        return loader();
+    }
+
+    std::size_t IMDSharedMemoryCache::getNumSegments() const {
+        RegistryLock lock(*registry);
+        std::size_t numSegments = 0;
+        for (const RegistryEntry &entry : registry->entries) {
+            numSegments += entry.state == ENTRY_READY ? 1 : 0;
+        }
+        return numSegments;
+    }
+
+    std::size_t IMDSharedMemoryCache::getSize() const {
+        RegistryLock lock(*registry);
+        return registry->size;
+    }
+
+    void IMDSharedMemoryCache::clear() const {
+        RegistryLock lock(*registry);
+        for (std::size_t i = 0; i < SHARED_MEMORY_CACHE_MAX_ENTRIES; ++i) {
+            if (registry->entries[i].state == ENTRY_READY && countHolders(registry->entries[i]) == 0) {
+                evictEntry(*registry, name, i);
+            }
+        }
+    }
+
+    void IMDSharedMemoryCache::remove(const std::string &name) {
+        const auto registry = openRegistry(name);
+        RegistryLock lock(*registry);
+        registry->removed = 1;
+        for (std::size_t i = 0; i < SHARED_MEMORY_CACHE_MAX_ENTRIES; ++i) {
+            // untracked views may belong to dead processes; unlinking leaves the mappings of live ones intact
+            RegistryEntry &entry = registry->entries[i];
+            if (entry.state == ENTRY_READY && countHolders(entry) == entry.numUntrackedHolders) {
+                evictEntry(*registry, name, i);
+            }
+        }
+        shm_unlink(("/" + name).c_str());
+        pthread_cond_broadcast(&registry->cond);
+    }
+
+}
@@ -0,0 +1,85 @@
+#ifndef IMD_IMDSHAREDMEMORYCACHE_H
+#define IMD_IMDSHAREDMEMORYCACHE_H
+
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "IMDData.h"
+#include "IMDFile.h"
+#include "IMDSharedMemoryException.h"
+
+#define DEFAULT_SHARED_MEMORY_CACHE_NAME "imdlib"
+#define DEFAULT_SHARED_MEMORY_CACHE_CAPACITY (std::size_t(8) << 30)
+#define SHARED_MEMORY_CACHE_MAX_ENTRIES 256
+// processes tracked per segment; can be raised at build time for nodes with more worker processes
+#ifndef SHARED_MEMORY_CACHE_MAX_HOLDERS
+#define SHARED_MEMORY_CACHE_MAX_HOLDERS 256
+#endif
+#define SHARED_MEMORY_SEGMENT_ALIGNMENT 64
+
+namespace imd {
+
+    // Node-local cache of IMD data in named POSIX shared memory segments. The first process reading a file parses it
+    // into a segment; other processes attach read-only and obtain IMDData views without parsing or copying the CSR
+    // arrays. A registry segment coordinates the processes: it counts the views each process holds on each segment
+    // and evicts unreferenced segments (least recently used first) when the capacity is exceeded. References held by
+    // processes that died are released. Up to SHARED_MEMORY_CACHE_MAX_HOLDERS processes are tracked per segment;
+    // views of further processes are only counted, so that a segment is not evicted while they exist, but they are
+    // not released if those processes die (the segment then stays cached until the registry is removed). If a segment
+    // cannot be created (e.g. /dev/shm is full), the data is returned uncached.
+    class IMDSharedMemoryCache {
+    public:
+        struct Registry;
+
+        struct Segment;
+
+    private:
+        const std::string name;
+        const std::size_t capacity;
+        std::shared_ptr<Registry> registry;
+
+        static std::shared_ptr<Registry> openRegistry(const std::string &name);
+
+        static std::string createFileKey(const std::string &path);
+
+        IMDData attachSegment(std::size_t entryIndex, std::uint64_t generation, bool tracked,
+                              const std::string &key) const;
+
+        IMDData createSegment(std::size_t entryIndex, std::uint64_t generation, const std::string &key,
+                              const IMDData &data) const;
+
+        void evict(std::size_t requiredSize) const;
+
+    public:
+        explicit IMDSharedMemoryCache(const std::string &name = DEFAULT_SHARED_MEMORY_CACHE_NAME,
+                                      std::size_t capacity = DEFAULT_SHARED_MEMORY_CACHE_CAPACITY);
+
+        IMDSharedMemoryCache(const IMDSharedMemoryCache &other) = delete;
+
+        IMDSharedMemoryCache &operator=(const IMDSharedMemoryCache &other) = delete;
+
+        // reads the data of the file (keyed by path, size and modification time) from the cache, parsing it first
+        // if it is not cached yet
+        IMDData readData(const IMDFile &file) const;
+
+        // returns a view on the data cached under the given key, calling the loader first if it is not cached yet
+        IMDData getData(const std::string &key, const std::function<IMDData()> &loader) const;
+
+        std::size_t getNumSegments() const;
+
+        std::size_t getSize() const;
+
+        // evicts all segments without attached views
+        void clear() const;
+
+        // removes the registry; existing views stay valid, cached segments without attached views are evicted
+        static void remove(const std::string &name = DEFAULT_SHARED_MEMORY_CACHE_NAME);
+
+    };
+
+}
+
+
+#endif //IMD_IMDSHAREDMEMORYCACHE_H
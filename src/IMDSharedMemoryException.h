@@ -0,0 +1,18 @@
+#ifndef IMD_IMDSHAREDMEMORYEXCEPTION_H
+#define IMD_IMDSHAREDMEMORYEXCEPTION_H
+
+
+#include <stdexcept>
+
+namespace imd {
+
+    class IMDSharedMemoryException : public std::runtime_error {
+
+        using std::runtime_error::runtime_error;
+
+    };
+
+}
+
+
+#endif //IMD_IMDSHAREDMEMORYEXCEPTION_H
@@ -0,0 +1,25 @@
+#ifndef IMD_TESTDATA_H
+#define IMD_TESTDATA_H
+
+
+#include <IMDData.h>
+
+// creates a data set of three markers, every other value of which is non-zero
+inline imd::IMDData createTestData(std::size_t numPushes) {
+    imd::IMDData data({"A", "B", "C"}, {2., 2., 2.}, {1., 1., 1.});
+    for (std::size_t pushIndex = 0; pushIndex < numPushes; ++pushIndex) {
+        data.pushOffsets.push_back(data.markerIndices.size());
+        for (std::size_t markerIndex = 0; markerIndex < 3; ++markerIndex) {
+            if ((pushIndex + markerIndex) % 2 == 1) {
+                data.markerIndices.push_back(markerIndex);
+                data.intensityValues.push_back((std::uint16_t) (pushIndex % 100 + markerIndex));
+                data.pulseValues.push_back(1);
+            }
+        }
+    }
+    data.pushOffsets.push_back(data.markerIndices.size());
+    return data;
+}
+
+
+#endif //IMD_TESTDATA_H
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include <IMDData.h>
+
+#include "TestData.h"
+
+using namespace imd;
+
+TEST(IMDData, toDense) {
+    const auto data = createTestData(10000);
+    const auto intensities = data.getIntensities();
+    const auto matrix = intensities.toDense();
+    ASSERT_EQ(matrix.size(), 10000 * 3);
+    for (std::size_t pushIndex = 0; pushIndex < 10000; ++pushIndex) {
+        for (std::size_t markerIndex = 0; markerIndex < 3; ++markerIndex) {
+            EXPECT_EQ(matrix[pushIndex * 3 + markerIndex], intensities(pushIndex, markerIndex));
+        }
+    }
+}
+
+TEST(IMDData, toDenseBuffer) {
+    const auto data = createTestData(10000);
+    const auto dualCounts = data.getDualCounts();
+    const auto matrix = dualCounts.toDense();
+    std::vector<float> buffer(7000 * 2, -1.f);
+    dualCounts.toDense(buffer.data(), 3000, 10000, {2, 0}, IMDData::DenseLayout::COLUMN_MAJOR, 3);
+    for (std::size_t row = 0; row < 7000; ++row) {
+        EXPECT_FLOAT_EQ(buffer[row], (float) matrix[(3000 + row) * 3 + 2]);
+        EXPECT_FLOAT_EQ(buffer[7000 + row], (float) matrix[(3000 + row) * 3]);
+    }
+    EXPECT_THROW(dualCounts.toDense(buffer.data(), 0, 10001, {0}), std::out_of_range);
+    EXPECT_THROW(dualCounts.toDense(buffer.data(), 0, 1, {3}), std::out_of_range);
+    EXPECT_THROW(dualCounts.toDense(buffer.data(), 0, 1, {0, 0}), std::invalid_argument);
+}
+
+TEST(IMDData, sharedAccessors) {
+    auto data = std::make_shared<IMDData>(createTestData(100));
+    const auto expected = data->getIntensities().toDense();
+    const auto intensities = data->getIntensities();
+    const auto dualCounts = data->getDualCounts(DEFAULT_PULSE_THRESHOLD, {1., 1., 1.}, {0., 0., 0.});
+    data.reset();
+    EXPECT_EQ(intensities.toDense(), expected);
+    EXPECT_DOUBLE_EQ(dualCounts(1, 0), (std::double_t) expected[3]);
+    EXPECT_THROW(intensities.getData().getDualCounts(3., {1.}, {0.}), std::invalid_argument);
+}
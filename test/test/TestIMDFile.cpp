@@ -1,12 +1,50 @@
+#include <atomic>
+#include <cstdlib>
 #include <gtest/gtest.h>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <new>
+#include <tuple>
 
 #include <IMDFile.h>
 
 #define IMD_FILE_PATH ""
+#define ALLOCATION_HEADER_SIZE alignof(std::max_align_t)
 
 using namespace imd;
 
+// counts allocations and tracks the peak of allocated bytes (measured while reading files)
+static std::atomic<std::size_t> numAllocations(0);
+static std::atomic<std::size_t> numAllocatedBytes(0);
+static std::atomic<std::size_t> peakAllocatedBytes(0);
+
+void *operator new(std::size_t size) {
+    void *ptr = std::malloc(size + ALLOCATION_HEADER_SIZE);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    *static_cast<std::size_t *>(ptr) = size;
+    ++numAllocations;
+    const std::size_t allocatedBytes = numAllocatedBytes += size;
+    std::size_t peakBytes = peakAllocatedBytes;
+    while (allocatedBytes > peakBytes && !peakAllocatedBytes.compare_exchange_weak(peakBytes, allocatedBytes)) {
+    }
+    return static_cast<char *>(ptr) + ALLOCATION_HEADER_SIZE;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr != nullptr) {
+        void *const allocation = static_cast<char *>(ptr) - ALLOCATION_HEADER_SIZE;
+        numAllocatedBytes -= *static_cast<std::size_t *>(allocation);
+        std::free(allocation);
+    }
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
 TEST(IMDFile, read) {
     IMDFile imdFile(IMD_FILE_PATH);
     auto data = imdFile.readData();
@@ -15,4 +53,89 @@ TEST(IMDFile, read) {
 TEST(IMDFile, readMetadata) {
     IMDFile imdFile(IMD_FILE_PATH);
     auto metadata = imdFile.readMetadata();
-}
\ No newline at end of file
+}
+// writes a synthetic IMD file (interleaved intensity/pulse values followed by the UTF-16 experiment schema)
+static std::string writeIMDFile(const std::string &fileName, std::size_t numPushes, std::size_t numMarkers,
+                                const std::function<std::uint16_t(std::size_t, std::size_t)> &intensity) {
+    const std::string path = testing::TempDir() + fileName;
+    std::ofstream file(path, std::ios_base::binary);
+    std::vector<std::uint16_t> push(2 * numMarkers);
+    for (std::size_t pushIndex = 0; pushIndex < numPushes; ++pushIndex) {
+        for (std::size_t markerIndex = 0; markerIndex < numMarkers; ++markerIndex) {
+            push[2 * markerIndex] = intensity(pushIndex, markerIndex);
+            push[2 * markerIndex + 1] = 1;
+        }
+        file.write((const char *) push.data(), push.size() * sizeof(std::uint16_t));
+    }
+    std::string schema = "<ExperimentSchema>";
+    for (std::size_t markerIndex = 0; markerIndex < numMarkers; ++markerIndex) {
+        schema += "<AcquisitionMarkers><ShortName>M" + std::to_string(markerIndex) + "</ShortName><Mass>" +
+                  std::to_string(100 + 25 * markerIndex) + "</Mass></AcquisitionMarkers>";
+    }
+    schema += "<DualAnalytesSnapshot><Mass>50</Mass><DualSlope>1</DualSlope>"
+              "<DualIntercept>0</DualIntercept></DualAnalytesSnapshot>"
+              "<DualAnalytesSnapshot><Mass>200</Mass><DualSlope>3</DualSlope>"
+              "<DualIntercept>0</DualIntercept></DualAnalytesSnapshot>"
+              "</ExperimentSchema>";
+    for (const char &c : schema) {
+        file.put(c).put(0x00);
+    }
+    return path;
+}
+
+TEST(IMDFile, readSynthetic) {
+    const auto path = writeIMDFile("synthetic.imd", 3000, 2, [](std::size_t pushIndex, std::size_t markerIndex) {
+        return (std::uint16_t) ((pushIndex + markerIndex) % 3);
+    });
+    const auto data = IMDFile(path).readData();
+    ASSERT_EQ(data.getNumPushes(), 3000u);
+    EXPECT_EQ(data.getMarkerNames(), std::vector<std::string>({"M0", "M1"}));
+    EXPECT_DOUBLE_EQ(data.getMarkerSlopes()[1], 2.);
+    const auto intensities = data.getIntensities();
+    for (std::size_t pushIndex = 0; pushIndex < 3000; ++pushIndex) {
+        EXPECT_EQ(intensities(pushIndex, 0), pushIndex % 3);
+        EXPECT_EQ(intensities(pushIndex, 1), (pushIndex + 1) % 3);
+    }
+}
+
+// reads the file, returning the peak of allocated bytes and the number of allocations
+static std::pair<std::size_t, std::size_t> measureRead(const std::string &path, IMDData *data) {
+    const std::size_t allocatedBytes = numAllocatedBytes;
+    const std::size_t allocations = numAllocations;
+    peakAllocatedBytes = allocatedBytes;
+    *data = IMDFile(path).readData();
+    return {peakAllocatedBytes - allocatedBytes, numAllocations - allocations};
+}
+
+TEST(IMDFile, readMemory) {
+    // the dense first chunk of the last file is not sampled, so its reservation is exceeded and grown once
+    const std::vector<std::tuple<std::string, std::function<std::uint16_t(std::size_t, std::size_t)>, std::size_t>> files = {
+            std::make_tuple("uniform", [](std::size_t pushIndex, std::size_t markerIndex) {
+                return (std::uint16_t) ((pushIndex + markerIndex) % 2);
+            }, 0),
+            std::make_tuple("sparse-first", [](std::size_t pushIndex, std::size_t markerIndex) {
+                return (std::uint16_t) (pushIndex < READ_BUFFER_NUM_PUSHES ? markerIndex == 0 : markerIndex % 2);
+            }, 0),
+            std::make_tuple("dense-first", [](std::size_t pushIndex, std::size_t markerIndex) {
+                return (std::uint16_t) (pushIndex < READ_BUFFER_NUM_PUSHES || markerIndex == pushIndex % 40);
+            }, 1)
+    };
+    IMDData data({}, {}, {});
+    // allocations not related to the number of pushes (e.g. parsing the schema)
+    const auto basePath = writeIMDFile("baseline.imd", READ_BUFFER_NUM_PUSHES, 40, std::get<1>(files[0]));
+    const std::size_t baseAllocations = measureRead(basePath, &data).second;
+    for (const auto &file : files) {
+        const auto &name = std::get<0>(file);
+        const std::size_t numReservationsExceeded = std::get<2>(file);
+        const auto path = writeIMDFile(name + ".imd", 64 * READ_BUFFER_NUM_PUSHES, 40, std::get<1>(file));
+        const auto measurement = measureRead(path, &data);
+        const std::size_t dataBytes = data.pushOffsets.size() * sizeof(std::size_t) +
+                                      data.markerIndices.size() * (sizeof(std::size_t) + 2 * sizeof(std::uint16_t));
+        std::cout << name << ": " << dataBytes << " data bytes, " << measurement.first << " peak bytes, "
+                  << measurement.second << " allocations" << std::endl;
+        // the CSR vectors never grow push by push; growing the reservation copies the non-zero vectors once
+        EXPECT_LT(measurement.first, (numReservationsExceeded > 0 ? 2. : 1.25) * dataBytes) << name;
+        EXPECT_LE(measurement.second, baseAllocations + 3 * numReservationsExceeded) << name;
+        EXPECT_LE(data.markerIndices.capacity(), NON_ZERO_SHRINK_FACTOR * data.markerIndices.size()) << name;
+    }
+}
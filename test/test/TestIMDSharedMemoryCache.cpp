@@ -0,0 +1,206 @@
+#include <atomic>
+#include <chrono>
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include <IMDSharedMemoryCache.h>
+
+#include "TestData.h"
+
+#define TEST_CACHE_NAME "imdlib-test"
+
+using namespace imd;
+
+// runs the function in a forked process and returns its exit code
+static int runInChildProcess(const std::function<int()> &function) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(function());
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+class IMDSharedMemoryCacheTest : public testing::Test {
+protected:
+    std::atomic<int> *numLoads = nullptr;
+
+    void SetUp() override {
+        IMDSharedMemoryCache::remove(TEST_CACHE_NAME);
+        // counts loads across processes
+        void *addr = mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        numLoads = new(addr) std::atomic<int>(0);
+    }
+
+    void TearDown() override {
+        IMDSharedMemoryCache::remove(TEST_CACHE_NAME);
+        munmap(numLoads, sizeof(std::atomic<int>));
+    }
+
+    std::function<IMDData()> createLoader(std::size_t numPushes, int delayMilliseconds = 0) {
+        return [this, numPushes, delayMilliseconds]() {
+            numLoads->fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMilliseconds));
+            return createTestData(numPushes);
+        };
+    }
+};
+
+TEST_F(IMDSharedMemoryCacheTest, getData) {
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    const auto expected = createTestData(1000).getIntensities().toDense();
+    {
+        const auto data = cache.getData("key", createLoader(1000));
+        EXPECT_TRUE(data.pushOffsets.isExternal());
+        EXPECT_EQ(data.getMarkerNames(), std::vector<std::string>({"A", "B", "C"}));
+        EXPECT_EQ(data.getIntensities().toDense(), expected);
+        EXPECT_EQ(data.pushOffsets.data()[1], 1u);
+        // attach from another process
+        EXPECT_EQ(runInChildProcess([&]() {
+            bool equal;
+            {
+                IMDSharedMemoryCache childCache(TEST_CACHE_NAME);
+                equal = childCache.getData("key", createLoader(0)).getIntensities().toDense() == expected;
+            }
+            return equal ? 0 : 1;
+        }), 0);
+        cache.clear();
+        EXPECT_EQ(cache.getNumSegments(), 1u);
+    }
+    EXPECT_EQ(cache.getData("key", createLoader(1000)).getNumPushes(), 1000u);
+    EXPECT_EQ(numLoads->load(), 1);
+    cache.clear();
+    EXPECT_EQ(cache.getNumSegments(), 0u);
+    EXPECT_EQ(cache.getSize(), 0u);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, evict) {
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME, 1);
+    cache.getData("key1", createLoader(10));
+    cache.getData("key2", createLoader(10));
+    EXPECT_EQ(cache.getNumSegments(), 1u);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, concurrentLoaders) {
+    std::vector<pid_t> pids;
+    for (int i = 0; i < 8; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            bool correct;
+            {
+                IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+                correct = cache.getData("key", createLoader(100, 100)).getNumPushes() == 100;
+            }
+            _exit(correct ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+    for (const pid_t pid : pids) {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    EXPECT_EQ(numLoads->load(), 1);
+    EXPECT_EQ(IMDSharedMemoryCache(TEST_CACHE_NAME).getNumSegments(), 1u);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, untrackedHolders) {
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    cache.getData("key", createLoader(100));
+    // more processes than the holder table tracks hold views at the same time
+    const int numProcesses = SHARED_MEMORY_CACHE_MAX_HOLDERS + 8;
+    void *addr = mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    auto *numAttached = new(addr) std::atomic<int>(0);
+    std::vector<pid_t> pids;
+    for (int i = 0; i < numProcesses; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            bool correct;
+            {
+                IMDSharedMemoryCache childCache(TEST_CACHE_NAME);
+                const auto data = childCache.getData("key", createLoader(100));
+                numAttached->fetch_add(1);
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+                while (numAttached->load() < numProcesses && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                correct = data.pushOffsets.isExternal() && data.getNumPushes() == 100;
+            }
+            _exit(correct ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+    for (const pid_t pid : pids) {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    munmap(addr, sizeof(std::atomic<int>));
+    EXPECT_EQ(numLoads->load(), 1);
+    // the untracked views were released
+    cache.clear();
+    EXPECT_EQ(cache.getNumSegments(), 0u);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, deadLoader) {
+    runInChildProcess([]() {
+        IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+        cache.getData("key", []() -> IMDData { _exit(0); });
+        return 1;
+    });
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    EXPECT_EQ(cache.getData("key", createLoader(100)).getNumPushes(), 100u);
+    EXPECT_EQ(numLoads->load(), 1);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, deadHolder) {
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    cache.getData("key", createLoader(100));
+    // the child process exits without releasing its view
+    EXPECT_EQ(runInChildProcess([]() {
+        IMDSharedMemoryCache childCache(TEST_CACHE_NAME);
+        const auto data = childCache.getData("key", []() { return createTestData(0); });
+        _exit(data.getNumPushes() == 100 ? 0 : 1);
+        return 1;
+    }), 0);
+    cache.clear();
+    EXPECT_EQ(cache.getNumSegments(), 0u);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, removeWithViews) {
+    auto oldCache = std::make_unique<IMDSharedMemoryCache>(TEST_CACHE_NAME);
+    auto oldData = std::make_unique<IMDData>(oldCache->getData("old", createLoader(100)));
+    IMDSharedMemoryCache::remove(TEST_CACHE_NAME);
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    cache.getData("new", createLoader(200));
+    // releasing the last view on the removed registry must not affect the segments of the new registry
+    EXPECT_EQ(oldData->getNumPushes(), 100u);
+    oldData.reset();
+    oldCache.reset();
+    EXPECT_EQ(cache.getData("new", createLoader(200)).getNumPushes(), 200u);
+    EXPECT_EQ(numLoads->load(), 2);
+}
+
+TEST_F(IMDSharedMemoryCacheTest, staleSegment) {
+    IMDSharedMemoryCache cache(TEST_CACHE_NAME);
+    cache.getData("key", createLoader(100));
+    // remove the segments behind the back of the registry
+    DIR *dir = opendir("/dev/shm");
+    ASSERT_NE(dir, nullptr);
+    for (dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+        const std::string fileName = entry->d_name;
+        if (fileName.rfind(TEST_CACHE_NAME ".", 0) == 0) {
+            shm_unlink(("/" + fileName).c_str());
+        }
+    }
+    closedir(dir);
+    EXPECT_EQ(cache.getData("key", createLoader(100)).getNumPushes(), 100u);
+    EXPECT_EQ(numLoads->load(), 2);
+    EXPECT_EQ(cache.getData("key", createLoader(100)).getNumPushes(), 100u);
+    EXPECT_EQ(numLoads->load(), 2);
+}